@@ -4,55 +4,168 @@
 #include <sys/resource.h>
 #include <pthread.h>
 #include <assert.h>
+#include <limits.h>
+#include <math.h>
 
 #include "cool.h"
 #include "internal/actor.h"
 #include "internal/buffer.h"
+#include "internal/future.h"
+#include "internal/scheduler.h"
+#include "internal/slab.h"
+#include "internal/symbol.h"
 #include "internal/encoding/cJSON.h"
+#include "internal/encoding/json_scan.h"
 #include "internal/ccn/ccn_fetcher.h"
 
-#define FILE_BLOCK_SIZE 128
+#define FILE_BLOCK_SIZE (64 * 1024)
+
+// Environments with more bindings than this get a hash index; smaller ones
+// (most lambda frames) are just scanned
+#define ENVIRONMENT_INDEX_THRESHOLD 8
 
 // builtin function
 typedef Value *(*cbuiltin)(Environment *, Value *);
 
+// Arithmetic operator, one kernel per representation
+typedef struct {
+    char *name;
+    int (*fixnum)(long a, long b, long *result); // returns 0 if the result does not fit in a fixnum
+    void (*bignum)(mpz_ptr result, mpz_srcptr a, mpz_srcptr b);
+    double (*fpnumber)(double a, double b); // NULL if the operator does not apply to doubles
+    int checkZero; // operands after the first must be nonzero
+} OperatorKernel;
+
+// Lambda bodies are compiled to a small stack machine the first time the
+// lambda is called. Each instruction is three ints: opcode, a, b.
+typedef enum {
+    CoolOp_Constant, // push constants[a]
+    CoolOp_Lookup,   // push the binding of symbol constants[a], trying frame slot b first
+    CoolOp_Call,     // apply the value below the top a values to them
+    CoolOp_TailCall, // as Call, but a lambda replaces the running frame instead of nesting
+    CoolOp_If,       // pop a builtin 'if' and its test, jumping to a when false; jump to b when 'if' was rebound
+    CoolOp_Jump,     // continue at a
+    CoolOp_Return    // return the top of the stack
+} CoolOp;
+
+typedef struct ccode {
+    int refcount;
+    int *instructions;
+    int length;
+    Value **constants;
+    int constantCount;
+    int stackSize;
+} Code;
+
+// Backing store for CoolValue_Bytes. Stores are never modified once filled,
+// so slices made by head and tail share them instead of copying.
+typedef struct {
+    int refcount;
+    size_t capacity;
+    uint8_t data[];
+} ByteStore;
+
 struct cval {
     uint8_t type;
+    uint8_t isBig; // integer is stored in bignumber rather than fixnumber
     union {
         double fpnumber;
         uint8_t byte;
+        long fixnumber;
         mpz_t bignumber;
         Actor *actor;
+        Future *future; // holds Values; the result is owned by the future
+        struct {
+            ByteStore *store;
+            size_t offset;
+            size_t length;
+        } bytes;
     };
 
     char *errorString;
-    char *symbolString;
+    SymbolID symbol;
+    const char *symbolString; // interned, never freed
     char *string;
 
     cbuiltin builtin;
     Environment *env;
     Value *formals;
     Value *body;
+    Code *code; // compiled body, shared by copies of the lambda
 
+    // cell points offset entries into an allocation of capacity entries, so
+    // popping the front is a pointer bump
     int count;
     struct cval **cell;
+    int offset;
+    int capacity;
     int error;
+
+    int refcount;
 };
 
 struct cenv {
     Environment *parent;
+    Environment *root;
     int count;
-    char **symbols;
+    int capacity;
+    SymbolID *symbols;
     struct cval **values;
+
+    // Open-addressing table of (slot + 1) into symbols/values, 0 when empty
+    int *index;
+    int indexCapacity;
+
+    // Bit (symbol % 64) is set for every symbol bound here, and in chainMask
+    // for every symbol bound here or in an ancestor below the root. Lookups of
+    // globals use them to jump past the call frames of a deep recursion.
+    uint64_t mask;
+    uint64_t chainMask;
+
+    // Read-only globals consulted after the root, or NULL. See environment_Share.
+    Environment *shared;
+
+    // Snapshot of this root handed out by environment_Share, dropped when
+    // the root changes
+    Environment *snapshot;
+
+    int refcount; // references to a shared snapshot
+
     CCNFetcher *fetcher;
 };
 
-// Wrapper for coroutines (from _Run builtin)
+// Function and environment of an actor
 typedef struct {
     Environment *env;
     Value *param;
 } EvaluateWrapper;
 
+// Optional arguments of spawn and service
+typedef struct {
+    size_t capacity;
+    ActorMailboxPolicy policy;
+    size_t replicas;
+    ActorPoolDispatch dispatch;
+} SpawnOptions;
+
+// Lambda attached to a future with `then`, run on the scheduler once the
+// future's result arrives
+typedef struct {
+    SchedulerTask task;
+    Environment *env;
+    Value *function;
+    Value *argument;
+    Future *future; // completed with the lambda's result
+} Continuation;
+
+// Expression handed to `run`, evaluated on the scheduler
+typedef struct {
+    SchedulerTask task;
+    Environment *env;
+    Value *expression;
+    Future *future; // completed with the expression's value
+} RunTask;
+
 // Forward declaration prototypes
 void value_Print(FILE *out, Value *value);
 void value_Println(FILE *out, Value *value);
@@ -60,13 +173,23 @@ Value *value_Eval(Environment *env, Value *value);
 void value_Delete(Value *value);
 Value *value_Error(char *fmt, ...);
 Value *value_Copy(Value *in);
+Value *value_Retain(Value *value);
+Value *value_Unshare(Value *value);
 char *value_TypeString(int type);
 Value *builtin_Eval(Environment *env, Value *x);
 Value *builtin_List(Environment *env, Value *x);
 Value *value_EvaluateExpression(Environment *env, Value *value);
 Value *value_Call(Environment *env, Value *function, Value *x);
-cJSON *value_ToJSON(Value *value);
-Value *value_FromJSON(cJSON *json);
+Value *value_CallFrame(Environment *env, Value *function, Value **args, int count);
+Code *value_Compile(Value *function);
+Code *code_Retain(Code *code);
+void code_Release(Code *code);
+Value *code_Execute(Code *code, Environment *env);
+void value_ReserveCells(Value *value, int count);
+CBuffer *value_Encode(Value *value);
+Value *value_Decode(const uint8_t *data, size_t length);
+CBuffer *value_EncodeJSON(Value *value);
+Value *value_DecodeJSON(const char *text);
 
 #define CASSERT(args, cond, fmt, ...) \
     if (!(cond)) { \
@@ -92,89 +215,286 @@ Value *value_FromJSON(cJSON *json);
 Environment *
 environment_Create()
 {
-    Environment *env = (Environment *) malloc(sizeof(Environment));
+    Environment *env = (Environment *) slab_Allocate(sizeof(Environment));
 
     env->parent = NULL;
+    env->root = env;
     env->count = 0;
-    env->symbols = (char **) malloc(sizeof(char *));
-    env->values = (Value **) malloc(sizeof(Value *));
+    env->capacity = 0;
+    env->symbols = NULL;
+    env->values = NULL;
+    env->index = NULL;
+    env->indexCapacity = 0;
+    env->mask = 0;
+    env->chainMask = 0;
+    env->shared = NULL;
+    env->snapshot = NULL;
+    env->refcount = 1;
     env->fetcher = ccnFetcher_Create();
 
     return env;
 }
 
+Environment *environment_Retain(Environment *env);
+void environment_Release(Environment *env);
+
 void
 environment_Delete(Environment *env)
 {
+    if (env->shared != NULL) {
+        environment_Release(env->shared);
+    }
+    if (env->snapshot != NULL) {
+        environment_Release(env->snapshot);
+    }
     for (int i = 0; i < env->count; i++) {
-        free(env->symbols[i]);
         value_Delete(env->values[i]);
     }
-    free(env->symbols);
-    free(env->values);
-    free(env);
+    slab_Free(env->symbols, sizeof(SymbolID) * env->capacity);
+    slab_Free(env->values, sizeof(Value *) * env->capacity);
+    slab_Free(env->index, sizeof(int) * env->indexCapacity);
+    slab_Free(env, sizeof(Environment));
+}
+
+uint64_t
+environment_MaskBit(SymbolID symbol)
+{
+    return (uint64_t) 1 << (symbol & 63);
+}
+
+int
+environment_IndexStart(Environment *env, SymbolID symbol)
+{
+    return (int) (((uint32_t) symbol * 2654435761u) & (uint32_t) (env->indexCapacity - 1));
+}
+
+void
+environment_IndexInsert(Environment *env, int slot)
+{
+    int mask = env->indexCapacity - 1;
+    int i = environment_IndexStart(env, env->symbols[slot]);
+    while (env->index[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    env->index[i] = slot + 1;
+}
+
+// Rebuild the index at no more than half full
+void
+environment_Reindex(Environment *env)
+{
+    slab_Free(env->index, sizeof(int) * env->indexCapacity);
+
+    env->indexCapacity = 2 * ENVIRONMENT_INDEX_THRESHOLD;
+    while (env->indexCapacity < 2 * env->count) {
+        env->indexCapacity *= 2;
+    }
+    env->index = (int *) slab_Allocate(sizeof(int) * env->indexCapacity);
+    memset(env->index, 0, sizeof(int) * env->indexCapacity);
+
+    for (int slot = 0; slot < env->count; slot++) {
+        environment_IndexInsert(env, slot);
+    }
+}
+
+// Return the slot holding symbol in this frame only, or -1
+int
+environment_Find(Environment *env, SymbolID symbol)
+{
+    if ((env->mask & environment_MaskBit(symbol)) == 0) {
+        return -1;
+    } else if (env->index == NULL) {
+        for (int i = 0; i < env->count; i++) {
+            if (env->symbols[i] == symbol) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    int mask = env->indexCapacity - 1;
+    for (int i = environment_IndexStart(env, symbol); env->index[i] != 0; i = (i + 1) & mask) {
+        int slot = env->index[i] - 1;
+        if (env->symbols[slot] == symbol) {
+            return slot;
+        }
+    }
+    return -1;
 }
 
 Value *
 environment_Get(Environment *env, Value *val)
 {
-    for (int i = 0; i < env->count; i++) {
-        if (strcmp(env->symbols[i], val->symbolString) == 0) {
-            return value_Copy(env->values[i]);
+    uint64_t bit = environment_MaskBit(val->symbol);
+    for (Environment *frame = env; frame != NULL; ) {
+        int slot = environment_Find(frame, val->symbol);
+        if (slot >= 0) {
+            return value_Retain(frame->values[slot]);
+        }
+        if (frame->parent == NULL) {
+            frame = frame->shared;
+        } else {
+            frame = (frame->chainMask & bit) != 0 ? frame->parent : frame->root;
         }
     }
 
-    if (env->parent) {
-        return environment_Get(env->parent, val);
-    } else {
-        return value_Error("Undefined symbol: %s", val->symbolString);
-    }
+    return value_Error("Undefined symbol: %s", val->symbolString);
 }
 
 void
-environment_PutKeyValue(Environment *env, Value* key, Value *val)
+environment_Bind(Environment *env, SymbolID symbol, Value *val)
 {
+    // Environments already sharing the old snapshot keep it; later ones
+    // get a fresh one
+    if (env->snapshot != NULL) {
+        environment_Release(env->snapshot);
+        env->snapshot = NULL;
+    }
+
     // Replace the value if it exists
-    for (int i = 0; i < env->count; i++) {
-        if (strcmp(env->symbols[i], key->symbolString) == 0) {
-            value_Delete(env->values[i]);
-            env->values[i] = value_Copy(val);
-            return;
-        }
+    int slot = environment_Find(env, symbol);
+    if (slot >= 0) {
+        Value *old = env->values[slot];
+        env->values[slot] = value_Retain(val);
+        value_Delete(old);
+        return;
+    }
+
+    if (env->count == env->capacity) {
+        int capacity = env->capacity == 0 ? 4 : 2 * env->capacity;
+        env->values = slab_Reallocate(env->values, sizeof(Value *) * env->capacity, sizeof(Value *) * capacity);
+        env->symbols = slab_Reallocate(env->symbols, sizeof(SymbolID) * env->capacity, sizeof(SymbolID) * capacity);
+        env->capacity = capacity;
     }
 
     env->count++;
-    env->values = realloc(env->values, sizeof(Value *) * env->count);
-    env->symbols = realloc(env->symbols, sizeof(char *) * env->count);
+    env->values[env->count - 1] = value_Retain(val);
+    env->symbols[env->count - 1] = symbol;
+    env->mask |= environment_MaskBit(symbol);
+    if (env->parent != NULL) {
+        env->chainMask |= environment_MaskBit(symbol);
+    }
+
+    if (env->index != NULL && 2 * env->count <= env->indexCapacity) {
+        environment_IndexInsert(env, env->count - 1);
+    } else if (env->count > ENVIRONMENT_INDEX_THRESHOLD) {
+        environment_Reindex(env);
+    }
+}
+
+void
+environment_PutKeyValue(Environment *env, Value* key, Value *val)
+{
+    environment_Bind(env, key->symbol, val);
+}
 
-    env->values[env->count - 1] = value_Copy(val);
-    env->symbols[env->count - 1] = malloc(strlen(key->symbolString) + 1);
-    strcpy(env->symbols[env->count - 1], key->symbolString);
+// Make env a call frame below parent, as dynamic scoping requires
+void
+environment_SetParent(Environment *env, Environment *parent)
+{
+    env->parent = parent;
+    env->root = parent->root;
+    env->chainMask = env->mask | parent->chainMask;
 }
 
 Environment *
 environment_Copy(Environment *env)
 {
-    Environment *copy = (Environment *) malloc(sizeof(Environment));
+    Environment *copy = (Environment *) slab_Allocate(sizeof(Environment));
     copy->parent = env->parent;
+    copy->root = env->parent != NULL ? env->root : copy;
     copy->count = env->count;
-    copy->symbols = (char **) malloc(sizeof(char *) * env->count);
-    copy->values = (Value **) malloc(sizeof(Value *) * env->count);
-    for (int i = 0; i < env->count; i++) {
-        copy->symbols[i] = (char *) malloc(strlen(env->symbols[i]) + 1);
-        strcpy(copy->symbols[i], env->symbols[i]);
-        copy->values[i] = value_Copy(env->values[i]);
+    copy->capacity = env->count;
+    copy->symbols = NULL;
+    copy->values = NULL;
+    copy->index = NULL;
+    copy->indexCapacity = 0;
+    copy->mask = env->mask;
+    copy->chainMask = env->chainMask;
+    copy->shared = env->shared != NULL ? environment_Retain(env->shared) : NULL;
+    copy->snapshot = NULL;
+    copy->refcount = 1;
+    copy->fetcher = env->fetcher;
+
+    if (env->count > 0) {
+        copy->symbols = (SymbolID *) slab_Allocate(sizeof(SymbolID) * env->count);
+        copy->values = (Value **) slab_Allocate(sizeof(Value *) * env->count);
+        memcpy(copy->symbols, env->symbols, sizeof(SymbolID) * env->count);
+        for (int i = 0; i < env->count; i++) {
+            copy->values[i] = value_Retain(env->values[i]);
+        }
+    }
+
+    if (env->index != NULL) {
+        copy->indexCapacity = env->indexCapacity;
+        copy->index = (int *) slab_Allocate(sizeof(int) * env->indexCapacity);
+        memcpy(copy->index, env->index, sizeof(int) * env->indexCapacity);
     }
+
     return copy;
 }
 
+Environment *
+environment_Retain(Environment *env)
+{
+    __sync_add_and_fetch(&env->refcount, 1);
+    return env;
+}
+
 void
-environment_DefineKeyValue(Environment *env, Value *key, Value *value)
+environment_Release(Environment *env)
 {
-    while (env->parent != NULL) {
-        env = env->parent;
+    if (__sync_sub_and_fetch(&env->refcount, 1) == 0) {
+        environment_Delete(env);
     }
-    environment_PutKeyValue(env, key, value);
+}
+
+// Make an empty global environment for work that runs beside env, such as
+// a `run` task. Lookups that miss fall through to env's call frames, folded
+// into it, and then to a read-only snapshot of env's globals. The snapshot
+// is shared by every environment made this way until env's root is next
+// changed, so a script calling `run` in a loop copies its globals once.
+// Definitions made in the new environment stay there.
+Environment *
+environment_Share(Environment *env)
+{
+    Environment *root = env->root;
+    if (root->snapshot == NULL) {
+        root->snapshot = environment_Copy(root);
+    }
+
+    Environment *shared = (Environment *) slab_Allocate(sizeof(Environment));
+    shared->parent = NULL;
+    shared->root = shared;
+    shared->count = 0;
+    shared->capacity = 0;
+    shared->symbols = NULL;
+    shared->values = NULL;
+    shared->index = NULL;
+    shared->indexCapacity = 0;
+    shared->mask = 0;
+    shared->chainMask = 0;
+    shared->shared = environment_Retain(root->snapshot);
+    shared->snapshot = NULL;
+    shared->refcount = 1;
+    shared->fetcher = env->fetcher;
+
+    // Innermost bindings win, as they would in a lookup from env
+    for (Environment *frame = env; frame != root; frame = frame->parent) {
+        for (int i = 0; i < frame->count; i++) {
+            if (environment_Find(shared, frame->symbols[i]) < 0) {
+                environment_Bind(shared, frame->symbols[i], frame->values[i]);
+            }
+        }
+    }
+
+    return shared;
+}
+
+void
+environment_DefineKeyValue(Environment *env, Value *key, Value *value)
+{
+    environment_PutKeyValue(env->root, key, value);
 }
 
 cJSON *
@@ -197,22 +517,94 @@ value_GetType(Value *value)
 }
 
 Value *
-value_Integer(size_t x)
+value_Integer(long x)
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_Integer;
+    value->refcount = 1;
+    value->isBig = 0;
+    value->fixnumber = x;
+    return value;
+}
 
-    mpz_init(value->bignumber);
-    mpz_set_ui(value->bignumber, x);
+// Move a fixnum into an mpz_t so that GMP can operate on it
+void
+value_IntegerPromote(Value *value)
+{
+    if (!value->isBig) {
+        long x = value->fixnumber;
+        mpz_init_set_si(value->bignumber, x);
+        value->isBig = 1;
+    }
+}
 
+// Drop a bignum back to a fixnum when it fits in a machine word
+Value *
+value_IntegerNormalize(Value *value)
+{
+    if (value->isBig && mpz_fits_slong_p(value->bignumber)) {
+        long x = mpz_get_si(value->bignumber);
+        mpz_clear(value->bignumber);
+        value->fixnumber = x;
+        value->isBig = 0;
+    }
     return value;
 }
 
+Value *
+value_IntegerFromString(char *string)
+{
+    errno = 0;
+    char *end = NULL;
+    long x = strtol(string, &end, 10);
+    if (errno == 0 && end != string && *end == '\0') {
+        return value_Integer(x);
+    }
+
+    Value *value = value_Integer(0);
+    value_IntegerPromote(value);
+    if (mpz_set_str(value->bignumber, string[0] == '+' ? string + 1 : string, 10) < 0) {
+        value_Delete(value);
+        return NULL;
+    }
+    return value_IntegerNormalize(value);
+}
+
+int
+value_IntegerSign(Value *value)
+{
+    if (value->type == CoolValue_Byte) {
+        return value->byte > 0;
+    } else if (value->isBig) {
+        return mpz_sgn(value->bignumber);
+    }
+    return (value->fixnumber > 0) - (value->fixnumber < 0);
+}
+
+int
+value_IntegerCompare(Value *x, Value *y)
+{
+    long a = x->type == CoolValue_Byte ? x->byte : x->fixnumber;
+    long b = y->type == CoolValue_Byte ? y->byte : y->fixnumber;
+    int xBig = x->type == CoolValue_Integer && x->isBig;
+    int yBig = y->type == CoolValue_Integer && y->isBig;
+
+    if (xBig && yBig) {
+        return mpz_cmp(x->bignumber, y->bignumber);
+    } else if (xBig) {
+        return mpz_cmp_si(x->bignumber, b);
+    } else if (yBig) {
+        return -mpz_cmp_si(y->bignumber, a);
+    }
+    return (a > b) - (a < b);
+}
+
 Value *
 value_Double(double x)
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_Double;
+    value->refcount = 1;
     value->fpnumber = x;
     return value;
 }
@@ -220,57 +612,129 @@ value_Double(double x)
 Value *
 value_Byte(uint8_t x)
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_Byte;
+    value->refcount = 1;
     value->byte = (long) x;
     return value;
 }
 
+ByteStore *
+byteStore_Create(size_t capacity)
+{
+    ByteStore *store = (ByteStore *) malloc(sizeof(ByteStore) + capacity);
+    store->refcount = 1;
+    store->capacity = capacity;
+    return store;
+}
+
+void
+byteStore_Release(ByteStore *store)
+{
+    if (__sync_sub_and_fetch(&store->refcount, 1) == 0) {
+        free(store);
+    }
+}
+
+// Wrap `length` bytes of `store` starting at `offset`, taking over the caller's reference
+Value *
+value_BytesFromStore(ByteStore *store, size_t offset, size_t length)
+{
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
+    value->type = CoolValue_Bytes;
+    value->refcount = 1;
+    value->bytes.store = store;
+    value->bytes.offset = offset;
+    value->bytes.length = length;
+    return value;
+}
+
+// Wrap `future`, taking over the caller's reference
+Value *
+value_Future(Future *future)
+{
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
+    value->type = CoolValue_Future;
+    value->refcount = 1;
+    value->future = future;
+    return value;
+}
+
+Value *
+value_Bytes(uint8_t *data, size_t length)
+{
+    ByteStore *store = byteStore_Create(length);
+    memcpy(store->data, data, length);
+    return value_BytesFromStore(store, 0, length);
+}
+
+uint8_t *
+value_BytesData(Value *value)
+{
+    return value->bytes.store->data + value->bytes.offset;
+}
+
+Value *
+value_BytesSlice(Value *value, size_t start, size_t length)
+{
+    __sync_fetch_and_add(&value->bytes.store->refcount, 1);
+    return value_BytesFromStore(value->bytes.store, value->bytes.offset + start, length);
+}
+
 Value *
 value_String(char *str)
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_String;
+    value->refcount = 1;
     value->string = (char *) malloc((strlen(str) + 1) * sizeof(char));
     strcpy(value->string, str);
     return value;
 }
 
 Value *
-value_Symbol(char *symbol)
+value_Symbol(const char *symbol)
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_Symbol;
-    value->symbolString = (char *) malloc((strlen(symbol) + 1) * sizeof(char));
-    strcpy(value->symbolString, symbol);
+    value->refcount = 1;
+    value->symbol = symbol_Intern(symbol);
+    value->symbolString = symbol_Name(value->symbol);
     return value;
 }
 
 Value *
 value_SExpr()
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_Sexpr;
+    value->refcount = 1;
     value->count = 0;
     value->cell = NULL;
+    value->offset = 0;
+    value->capacity = 0;
     return value;
 }
 
 Value *
 value_QExpr()
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_Qexpr;
+    value->refcount = 1;
     value->count = 0;
     value->cell = NULL;
+    value->offset = 0;
+    value->capacity = 0;
     return value;
 }
 
 Value *
 value_Builtin(cbuiltin function)
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_Function;
+    value->refcount = 1;
     value->builtin = function;
     return value;
 }
@@ -278,54 +742,107 @@ value_Builtin(cbuiltin function)
 Value *
 value_Lambda(Value *formals, Value *body)
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_Function;
+    value->refcount = 1;
     value->builtin = NULL;
     value->env = environment_Create();
     value->formals = formals;
     value->body = body;
+    value->code = NULL;
     return value;
 }
 
-cJSON *
-value_FunctionWrapper(EvaluateWrapper *wrapper, cJSON *encodedParameters) {
-    Value *parameters = value_FromJSON(encodedParameters);
-    Value *functionBody = value_Copy(wrapper->param);
-    Value *result = value_Call(wrapper->env, functionBody, parameters);
-    cJSON *encodedResult = value_ToJSON(result);
+// Actor handler for senders in this process. The arguments arrive as the
+// sender's own Value, possibly still shared with it, so take a private list
+// before binding consumes it.
+Value *
+value_FunctionCall(EvaluateWrapper *wrapper, Value *parameters) {
+    parameters = value_Unshare(parameters);
+    return value_Call(wrapper->env, wrapper->param, parameters);
+}
+
+// Actor handler for requests arriving over CCN, which are binary encoded
+CBuffer *
+value_FunctionWrapper(EvaluateWrapper *wrapper, const uint8_t *message, size_t length) {
+    Value *parameters = value_Decode(message, length);
+    Value *result = parameters != NULL ? value_FunctionCall(wrapper, parameters)
+        : value_Error("Unable to decode the message");
+    CBuffer *encodedResult = value_Encode(result);
+    value_Delete(result);
+    if (encodedResult == NULL) {
+        Value *error = value_Error("Unable to encode the reply");
+        encodedResult = value_Encode(error);
+        value_Delete(error);
+    }
     return encodedResult;
 }
 
+EvaluateWrapper *
+value_ActorWrapper(Environment *env, Value *function)
+{
+    EvaluateWrapper *wrapper = (EvaluateWrapper *) malloc(sizeof(EvaluateWrapper));
+    wrapper->env = env;
+    wrapper->param = value_Retain(function);
+    return wrapper;
+}
+
+// The local actor running wrapper or, for more than one replica, a pool of
+// them. Each further replica gets its own copy of env, so replicas never
+// share an environment that a definition could change under them.
+Actor *
+value_ActorReplicas(EvaluateWrapper *wrapper, Environment *env, size_t replicas, ActorPoolDispatch dispatch)
+{
+    Actor *first = actor_CreateLocal((void *) wrapper, (void *(*)(void *, void *)) value_FunctionCall,
+        (void (*)(void *)) value_Delete);
+    if (replicas <= 1) {
+        return first;
+    }
+
+    Actor **actors = (Actor **) malloc(sizeof(Actor *) * replicas);
+    actors[0] = first;
+    for (size_t i = 1; i < replicas; i++) {
+        EvaluateWrapper *replica = value_ActorWrapper(environment_Copy(env), wrapper->param);
+        actors[i] = actor_CreateLocal((void *) replica, (void *(*)(void *, void *)) value_FunctionCall,
+            (void (*)(void *)) value_Delete);
+    }
+    Actor *pool = actor_CreatePool(actors, replicas, dispatch);
+    free(actors);
+
+    return pool;
+}
+
 Value *
-value_ActorLocal(Environment *env, Value *function)
+value_ActorLocal(Environment *env, Value *function, size_t replicas, ActorPoolDispatch dispatch)
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_Actor;
+    value->refcount = 1;
     value->count = 0;
     value->cell = NULL;
     value->env = environment_Copy(env);
 
-    EvaluateWrapper *wrapper = (EvaluateWrapper *) malloc(sizeof(EvaluateWrapper));
-    wrapper->env = value->env;
-    wrapper->param = value_Copy(function);
-    value->actor = actor_CreateLocal((void *) wrapper, (cJSON *(*)(void *, cJSON *)) value_FunctionWrapper);
+    EvaluateWrapper *wrapper = value_ActorWrapper(value->env, function);
+    value->actor = value_ActorReplicas(wrapper, env, replicas, dispatch);
 
     return value;
 }
 
 Value *
-value_ActorGlobal(Environment *env, Value *function, char *name)
+value_ActorGlobal(Environment *env, Value *function, char *name, size_t replicas, ActorPoolDispatch dispatch)
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_Actor;
+    value->refcount = 1;
     value->count = 0;
     value->cell = NULL;
     value->env = environment_Copy(env);
 
-    EvaluateWrapper *wrapper = (EvaluateWrapper *) malloc(sizeof(EvaluateWrapper));
-    wrapper->env = value->env;
-    wrapper->param = value_Copy(function);
-    value->actor = actor_CreateGlobal(name, (void *) wrapper, (cJSON *(*)(void *, cJSON *)) value_FunctionWrapper);
+    // Requests over CCN are handled by the producer's own thread with the
+    // first replica's environment
+    EvaluateWrapper *wrapper = value_ActorWrapper(value->env, function);
+    value->actor = actor_Publish(name, value_ActorReplicas(wrapper, env, replicas, dispatch), (void *) wrapper,
+        (CBuffer *(*)(void *, const uint8_t *, size_t)) value_FunctionWrapper);
 
     return value;
 }
@@ -333,8 +850,9 @@ value_ActorGlobal(Environment *env, Value *function, char *name)
 Value *
 value_Error(char *fmt, ...)
 {
-    Value *value = (Value *) malloc(sizeof(Value));
+    Value *value = (Value *) slab_Allocate(sizeof(Value));
     value->type = CoolValue_Error;
+    value->refcount = 1;
 
     va_list va;
     va_start(va, fmt);
@@ -370,6 +888,10 @@ value_TypeString(int type)
             return "CoolValue_String";
         case CoolValue_Actor:
             return "CoolValue_Actor";
+        case CoolValue_Bytes:
+            return "CoolValue_Bytes";
+        case CoolValue_Future:
+            return "CoolValue_Future";
         case CoolValue_Symbol:
         default:
             return "CoolValue_Symbol";
@@ -381,182 +903,721 @@ value_TypeString(int type)
 //mpz_t bignumber;
 //Actor *actor;
 
-cJSON *
-value_ToJSON(Value *value)
+// Deepest nesting of lists that the decoders accept, so that hostile input
+// cannot exhaust the stack
+#define VALUE_DECODE_MAX_DEPTH 1024
+
+// Most symbols that decoding binary input may add to the symbol table over
+// the life of the process. Names already interned are always accepted.
+#define VALUE_DECODE_MAX_SYMBOLS 65536
+static int _decodedSymbols;
+
+// Streaming JSON, used by `encode` and `decode`. Values are written straight
+// into a buffer, and read straight from text, in the form
+// {"type": ..., "value": ...}, with no cJSON tree in between.
+
+static void
+json_WriteString(CBuffer *buffer, const char *string, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    // Copy runs of plain characters in one go and escape the rest
+    cbuffer_AppendByte(buffer, '"');
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = (uint8_t) string[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        cbuffer_AppendBytes(buffer, i - start, (uint8_t *) string + start);
+        start = i + 1;
+
+        switch (c) {
+            case '"':
+                cbuffer_AppendString(buffer, "\\\"");
+                break;
+            case '\\':
+                cbuffer_AppendString(buffer, "\\\\");
+                break;
+            case '\b':
+                cbuffer_AppendString(buffer, "\\b");
+                break;
+            case '\f':
+                cbuffer_AppendString(buffer, "\\f");
+                break;
+            case '\n':
+                cbuffer_AppendString(buffer, "\\n");
+                break;
+            case '\r':
+                cbuffer_AppendString(buffer, "\\r");
+                break;
+            case '\t':
+                cbuffer_AppendString(buffer, "\\t");
+                break;
+            default: {
+                char escape[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F], '\0' };
+                cbuffer_AppendString(buffer, escape);
+                break;
+            }
+        }
+    }
+    cbuffer_AppendBytes(buffer, length - start, (uint8_t *) string + start);
+    cbuffer_AppendByte(buffer, '"');
+}
+
+// Append the JSON form of value to buffer. Returns 0 if some part of it has
+// no JSON form, leaving buffer partly written.
+int
+value_WriteJSON(Value *value, CBuffer *buffer)
 {
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "type", value_GetType(value));
+    // Room for any number printed below: "%.17g" needs at most 24 characters
+    char number[64];
+    snprintf(number, sizeof(number), "{\"type\":%d", value_GetType(value));
+    cbuffer_AppendString(buffer, number);
 
     switch (value->type) {
         case CoolValue_Error:
-            cJSON_AddItemToObject(root, "value", cJSON_CreateString(value->errorString));
+            cbuffer_AppendString(buffer, ",\"value\":");
+            json_WriteString(buffer, value->errorString, strlen(value->errorString));
             break;
         case CoolValue_Function:
-            // TODO: finishme
-            // return "CoolValue_Function";
+            // Only the type
             break;
         case CoolValue_Qexpr:
-        case CoolValue_Sexpr: {
-            cJSON *list = cJSON_CreateArray();
+        case CoolValue_Sexpr:
+            cbuffer_AppendString(buffer, ",\"value\":[");
             for (int i = 0; i < value->count; i++) {
-                cJSON *jsonForm = value_ToJSON(value->cell[i]);
-                cJSON_AddItemToArray(list, jsonForm);
-                // TODO: is this a leak?...
+                if (i > 0) {
+                    cbuffer_AppendByte(buffer, ',');
+                }
+                if (!value_WriteJSON(value->cell[i], buffer)) {
+                    return 0;
+                }
             }
-            cJSON_AddItemToObject(root, "value", list);
+            cbuffer_AppendByte(buffer, ']');
             break;
-        }
-        case CoolValue_Integer: {
-            char *stringForm = mpz_get_str(NULL, 10, value->bignumber);
-            cJSON_AddItemToObject(root, "value", cJSON_CreateString(stringForm));
-            free(stringForm);
+        case CoolValue_Integer:
+            cbuffer_AppendString(buffer, ",\"value\":\"");
+            if (value->isBig) {
+                char *stringForm = mpz_get_str(NULL, 10, value->bignumber);
+                cbuffer_AppendString(buffer, stringForm);
+                free(stringForm);
+            } else {
+                snprintf(number, sizeof(number), "%ld", value->fixnumber);
+                cbuffer_AppendString(buffer, number);
+            }
+            cbuffer_AppendByte(buffer, '"');
             break;
-        }
-        case CoolValue_Double: {
-            char *stringForm = NULL;
-            asprintf(&stringForm, "%f", value->fpnumber);
-            cJSON_AddItemToObject(root, "value", cJSON_CreateString(stringForm));
-            free(stringForm);
+        case CoolValue_Double:
+            snprintf(number, sizeof(number), "%.17g", value->fpnumber);
+            cbuffer_AppendString(buffer, ",\"value\":\"");
+            cbuffer_AppendString(buffer, number);
+            cbuffer_AppendByte(buffer, '"');
             break;
-        }
-        case CoolValue_Byte: {
-            char *stringForm = NULL;
-            asprintf(&stringForm, "%d", value->byte);
-            cJSON_AddItemToObject(root, "value", cJSON_CreateString(stringForm));
-            free(stringForm);
+        case CoolValue_Byte:
+            snprintf(number, sizeof(number), "%d", value->byte);
+            cbuffer_AppendString(buffer, ",\"value\":\"");
+            cbuffer_AppendString(buffer, number);
+            cbuffer_AppendByte(buffer, '"');
             break;
-        }
-        case CoolValue_String: {
-            cJSON_AddItemToObject(root, "value", cJSON_CreateString(value->string));
+        case CoolValue_String:
+            cbuffer_AppendString(buffer, ",\"value\":");
+            json_WriteString(buffer, value->string, strlen(value->string));
+            break;
+        case CoolValue_Bytes: {
+            static const char hex[] = "0123456789abcdef";
+            uint8_t *data = value_BytesData(value);
+            cbuffer_AppendString(buffer, ",\"value\":\"");
+            for (size_t i = 0; i < value->bytes.length; i++) {
+                uint8_t pair[] = { hex[data[i] >> 4], hex[data[i] & 0x0F] };
+                cbuffer_AppendBytes(buffer, 2, pair);
+            }
+            cbuffer_AppendByte(buffer, '"');
             break;
         }
-        case CoolValue_Actor:
-        case CoolValue_Symbol:
         default:
-            cJSON_Delete(root);
-            return NULL;
+            return 0;
     }
 
-    return root;
+    cbuffer_AppendByte(buffer, '}');
+    return 1;
 }
 
-Value *
-value_FromJSON(cJSON *json)
+static int
+json_ReadHex(const char **cursor, unsigned long *code)
 {
-    Value *result = NULL;
-
-    cJSON *typeJson = cJSON_GetObjectItem(json, "type");
-    char *typeString = cJSON_PrintUnformatted(typeJson);
-    int type = atoi(typeString);
-    free(typeString);
-
-    switch (type) {
-        case CoolValue_Error: {
-            cJSON *valueJson = cJSON_GetObjectItem(json, "value");
-            result->errorString = cJSON_PrintUnformatted(valueJson);
-            break;
+    *code = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = (*cursor)[i];
+        int digit = c >= '0' && c <= '9' ? c - '0'
+            : c >= 'a' && c <= 'f' ? c - 'a' + 10
+            : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) {
+            return 0;
         }
-        case CoolValue_Function:
-            // TODO: finishme
-            break;
-        case CoolValue_Qexpr:
-        case CoolValue_Sexpr: {
-            cJSON *valueJson = cJSON_GetObjectItem(json, "value"); // array
-            result = value_SExpr();
-            int size = cJSON_GetArraySize(valueJson);
-
-            for (int i = 0; i < size; i++) {
-                cJSON *arrayItem = cJSON_GetArrayItem(valueJson, i);
-                Value *arrayValue = value_FromJSON(arrayItem);
-                value_AddCell(result, arrayValue);
-            }
+        *code = (*code << 4) | digit;
+    }
+    *cursor += 4;
+    return 1;
+}
+
+static void
+json_AppendUTF8(CBuffer *buffer, unsigned long code)
+{
+    if (code < 0x80) {
+        cbuffer_AppendByte(buffer, code);
+    } else if (code < 0x800) {
+        cbuffer_AppendByte(buffer, 0xC0 | (code >> 6));
+        cbuffer_AppendByte(buffer, 0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        cbuffer_AppendByte(buffer, 0xE0 | (code >> 12));
+        cbuffer_AppendByte(buffer, 0x80 | ((code >> 6) & 0x3F));
+        cbuffer_AppendByte(buffer, 0x80 | (code & 0x3F));
+    } else {
+        cbuffer_AppendByte(buffer, 0xF0 | (code >> 18));
+        cbuffer_AppendByte(buffer, 0x80 | ((code >> 12) & 0x3F));
+        cbuffer_AppendByte(buffer, 0x80 | ((code >> 6) & 0x3F));
+        cbuffer_AppendByte(buffer, 0x80 | (code & 0x3F));
+    }
+}
 
+// Read a JSON string into buffer, unescaped and NUL-terminated. Returns 0 if
+// it is malformed or contains a NUL.
+static int
+json_ReadString(const char **cursor, CBuffer *buffer)
+{
+    const char *p = jsonScan_SkipSpace(*cursor);
+    if (*p++ != '"') {
+        return 0;
+    }
+
+    for (;;) {
+        const char *start = p;
+        p = jsonScan_FindSpecial(p);
+        cbuffer_AppendBytes(buffer, p - start, (uint8_t *) start);
+        if (*p == '"') {
             break;
+        } else if (*p != '\\') {
+            // A control character or the end of the input
+            return 0;
         }
-        case CoolValue_Integer: {
-            cJSON *valueJson = cJSON_GetObjectItem(json, "value");
-            char *valueString = cJSON_PrintUnformatted(valueJson);
-
-            int length = strlen(valueString) - 2;
-            char *unformattedString = malloc(length);
-            memcpy(unformattedString, valueString + 1, length);
 
-            result = value_Integer(0);
-            int valid = mpz_set_str(result->bignumber, unformattedString, 10);
-            if (valid < 0) {
-                // TODO: real error checking
-                return NULL;
+        p++;
+        switch (*p++) {
+            case '"':
+                cbuffer_AppendByte(buffer, '"');
+                break;
+            case '\\':
+                cbuffer_AppendByte(buffer, '\\');
+                break;
+            case '/':
+                cbuffer_AppendByte(buffer, '/');
+                break;
+            case 'b':
+                cbuffer_AppendByte(buffer, '\b');
+                break;
+            case 'f':
+                cbuffer_AppendByte(buffer, '\f');
+                break;
+            case 'n':
+                cbuffer_AppendByte(buffer, '\n');
+                break;
+            case 'r':
+                cbuffer_AppendByte(buffer, '\r');
+                break;
+            case 't':
+                cbuffer_AppendByte(buffer, '\t');
+                break;
+            case 'u': {
+                unsigned long code;
+                if (!json_ReadHex(&p, &code) || code == 0 || (code >= 0xDC00 && code <= 0xDFFF)) {
+                    return 0;
+                }
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    // The high half of a surrogate pair; the low half must follow
+                    unsigned long low;
+                    if (p[0] != '\\' || p[1] != 'u') {
+                        return 0;
+                    }
+                    p += 2;
+                    if (!json_ReadHex(&p, &low) || low < 0xDC00 || low > 0xDFFF) {
+                        return 0;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                json_AppendUTF8(buffer, code);
+                break;
             }
+            default:
+                return 0;
+        }
+    }
 
-            free(valueString);
-            free(unformattedString);
+    cbuffer_AppendByte(buffer, '\0');
+    *cursor = p + 1;
+    return 1;
+}
 
-            break;
-        }
+// Read a key and its colon, checking that the key is `expected`
+static int
+json_ReadKey(const char **cursor, CBuffer *scratch, const char *expected)
+{
+    cbuffer_Clear(scratch);
+    if (!json_ReadString(cursor, scratch) || strcmp((char *) cbuffer_GetBytes(scratch), expected) != 0) {
+        return 0;
+    }
+    *cursor = jsonScan_SkipSpace(*cursor);
+    if (**cursor != ':') {
+        return 0;
+    }
+    (*cursor)++;
+    return 1;
+}
+
+// Build the value of the given type from the string in its JSON "value"
+static Value *
+json_ValueFromString(long type, char *string)
+{
+    char *end = NULL;
+
+    switch (type) {
+        case CoolValue_Integer:
+            return value_IntegerFromString(string);
         case CoolValue_Double: {
-            cJSON *valueJson = cJSON_GetObjectItem(json, "value");
-            char *valueString = cJSON_PrintUnformatted(valueJson);
-            result->fpnumber = atof(valueString);
-            free(valueString);
-            break;
+            double x = strtod(string, &end);
+            return end != string && *end == '\0' ? value_Double(x) : NULL;
         }
         case CoolValue_Byte: {
-            cJSON *valueJson = cJSON_GetObjectItem(json, "value");
-            char *valueString = cJSON_PrintUnformatted(valueJson);
-            result->byte = (uint8_t) atoi(valueString);
-            free(valueString);
-            break;
+            long x = strtol(string, &end, 10);
+            return end != string && *end == '\0' && x >= 0 && x <= 255 ? value_Byte((uint8_t) x) : NULL;
         }
-        case CoolValue_String: {
-            cJSON *valueJson = cJSON_GetObjectItem(json, "value");
-            result->string = cJSON_PrintUnformatted(valueJson);
-            break;
+        case CoolValue_String:
+            return value_String(string);
+        case CoolValue_Error:
+            return value_Error("%s", string);
+        case CoolValue_Bytes: {
+            size_t length = strlen(string);
+            if (length % 2 != 0) {
+                return NULL;
+            }
+            ByteStore *store = byteStore_Create(length / 2);
+            for (size_t i = 0; i < length; i++) {
+                char c = string[i];
+                int digit = c >= '0' && c <= '9' ? c - '0'
+                    : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                    : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+                if (digit < 0) {
+                    byteStore_Release(store);
+                    return NULL;
+                }
+                store->data[i / 2] = (i % 2 == 0) ? digit << 4 : store->data[i / 2] | digit;
+            }
+            return value_BytesFromStore(store, 0, length / 2);
         }
-        case CoolValue_Actor:
+        default:
+            return NULL;
+    }
+}
 
-            // return "CoolValue_Actor";
-            break;
-        case CoolValue_Symbol:
+// Read one value at *cursor, which is left just past it. Returns NULL if the
+// text is malformed or the value cannot be decoded. The "type" member must
+// come first, as both JSON encoders write it.
+static Value *
+value_ReadJSON(const char **cursor, CBuffer *scratch, int depth)
+{
+    const char *p = jsonScan_SkipSpace(*cursor);
+    if (*p++ != '{' || depth > VALUE_DECODE_MAX_DEPTH || !json_ReadKey(&p, scratch, "type")) {
+        return NULL;
+    }
+
+    char *end = NULL;
+    long type = strtol(p, &end, 10);
+    if (end == p) {
+        return NULL;
+    }
+    p = jsonScan_SkipSpace(end);
+
+    // Functions are encoded as their type alone and cannot be decoded
+    if (*p++ != ',' || !json_ReadKey(&p, scratch, "value")) {
+        return NULL;
+    }
+
+    Value *result = NULL;
+    if (type == CoolValue_Sexpr || type == CoolValue_Qexpr) {
+        p = jsonScan_SkipSpace(p);
+        if (*p++ != '[') {
+            return NULL;
+        }
+        result = type == CoolValue_Sexpr ? value_SExpr() : value_QExpr();
+        p = jsonScan_SkipSpace(p);
+        if (*p == ']') {
+            p++;
+        } else {
+            for (;;) {
+                Value *cell = value_ReadJSON(&p, scratch, depth + 1);
+                if (cell == NULL) {
+                    value_Delete(result);
+                    return NULL;
+                }
+                result = value_AddCell(result, cell);
+
+                p = jsonScan_SkipSpace(p);
+                if (*p == ',') {
+                    p++;
+                } else if (*p == ']') {
+                    p++;
+                    break;
+                } else {
+                    value_Delete(result);
+                    return NULL;
+                }
+            }
+        }
+    } else {
+        cbuffer_Clear(scratch);
+        if (!json_ReadString(&p, scratch) || (result = json_ValueFromString(type, (char *) cbuffer_GetBytes(scratch))) == NULL) {
+            return NULL;
+        }
+    }
+
+    p = jsonScan_SkipSpace(p);
+    if (*p++ != '}') {
+        value_Delete(result);
+        return NULL;
+    }
+    *cursor = p;
+    return result;
+}
+
+// Encode value as NUL-terminated JSON, or return NULL if it has no JSON form
+CBuffer *
+value_EncodeJSON(Value *value)
+{
+    CBuffer *buffer = cbuffer_Create();
+    if (value_WriteJSON(value, buffer)) {
+        cbuffer_AppendByte(buffer, '\0');
+    } else {
+        cbuffer_Delete(&buffer);
+    }
+    return buffer;
+}
+
+// Decode the one value in text, or return NULL if it holds anything else
+Value *
+value_DecodeJSON(const char *text)
+{
+    CBuffer *scratch = cbuffer_Create();
+    Value *result = value_ReadJSON(&text, scratch, 0);
+    cbuffer_Delete(&scratch);
+    if (result != NULL && *jsonScan_SkipSpace(text) != '\0') {
+        value_Delete(result);
+        return NULL;
+    }
+    return result;
+}
+
+// Binary wire format, used by `encode`/`decode` and for requests to CCN
+// services. A value is its CoolValue type in one byte and a LEB128 length,
+// followed by:
+//
+//     Integer                sign (0 or 1), then the magnitude in big-endian bytes
+//     Double                 the IEEE 754 bits, little-endian
+//     Byte                   the byte
+//     String, Error, Symbol  the characters, unterminated
+//     Bytes                  the bytes
+//     Sexpr, Qexpr           nothing: the length counts the cells, which follow
+//
+// Functions, actors and futures have no encoding. Decoding never makes up
+// code to run, and only adds a bounded number of new names to the symbol
+// table, which is never freed.
+
+static void
+value_BinaryHeader(CBuffer *buffer, CoolValue type, uint64_t length)
+{
+    cbuffer_AppendByte(buffer, (uint8_t) type);
+    cbuffer_AppendVarint(buffer, length);
+}
+
+// Append the encoding of value to buffer. Returns 0 if some part of it has
+// no encoding, leaving buffer partly written.
+int
+value_ToBinary(Value *value, CBuffer *buffer)
+{
+    switch (value->type) {
+        case CoolValue_Integer: {
+            if (value->isBig) {
+                size_t length = 0;
+                uint8_t *magnitude = (uint8_t *) malloc((mpz_sizeinbase(value->bignumber, 2) + 7) / 8);
+                mpz_export(magnitude, &length, 1, 1, 1, 0, value->bignumber);
+                value_BinaryHeader(buffer, CoolValue_Integer, length + 1);
+                cbuffer_AppendByte(buffer, mpz_sgn(value->bignumber) < 0);
+                cbuffer_AppendBytes(buffer, length, magnitude);
+                free(magnitude);
+            } else {
+                uint8_t magnitude[sizeof(unsigned long)];
+                size_t length = 0;
+                unsigned long x = value->fixnumber < 0 ? -(unsigned long) value->fixnumber : (unsigned long) value->fixnumber;
+                for (; x > 0; x >>= 8) {
+                    magnitude[sizeof(magnitude) - ++length] = x & 0xFF;
+                }
+                value_BinaryHeader(buffer, CoolValue_Integer, length + 1);
+                cbuffer_AppendByte(buffer, value->fixnumber < 0);
+                cbuffer_AppendBytes(buffer, length, magnitude + sizeof(magnitude) - length);
+            }
+            return 1;
+        }
+        case CoolValue_Double: {
+            uint64_t bits;
+            uint8_t bytes[8];
+            memcpy(&bits, &value->fpnumber, sizeof(bits));
+            for (int i = 0; i < 8; i++) {
+                bytes[i] = (bits >> (8 * i)) & 0xFF;
+            }
+            value_BinaryHeader(buffer, CoolValue_Double, 8);
+            cbuffer_AppendBytes(buffer, 8, bytes);
+            return 1;
+        }
+        case CoolValue_Byte:
+            value_BinaryHeader(buffer, CoolValue_Byte, 1);
+            cbuffer_AppendByte(buffer, value->byte);
+            return 1;
+        case CoolValue_String:
+        case CoolValue_Error:
+        case CoolValue_Symbol: {
+            const char *string = value->type == CoolValue_String ? value->string
+                : value->type == CoolValue_Error ? value->errorString : value->symbolString;
+            size_t length = strlen(string);
+            value_BinaryHeader(buffer, (CoolValue) value->type, length);
+            cbuffer_AppendBytes(buffer, length, (const uint8_t *) string);
+            return 1;
+        }
+        case CoolValue_Bytes:
+            value_BinaryHeader(buffer, CoolValue_Bytes, value->bytes.length);
+            cbuffer_AppendBytes(buffer, value->bytes.length, value_BytesData(value));
+            return 1;
+        case CoolValue_Sexpr:
+        case CoolValue_Qexpr:
+            value_BinaryHeader(buffer, (CoolValue) value->type, value->count);
+            for (int i = 0; i < value->count; i++) {
+                if (!value_ToBinary(value->cell[i], buffer)) {
+                    return 0;
+                }
+            }
+            return 1;
         default:
-            break;
-            // return "CoolValue_Symbol";
+            return 0;
+    }
+}
+
+static int
+value_ReadVarint(const uint8_t **cursor, const uint8_t *end, uint64_t *x)
+{
+    *x = 0;
+    for (int shift = 0; shift < 64 && *cursor < end; shift += 7) {
+        uint8_t byte = *(*cursor)++;
+        *x |= (uint64_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns 1 if name is already a symbol or may become one, counting it
+// against VALUE_DECODE_MAX_SYMBOLS
+static int
+value_MayInternSymbol(const char *name)
+{
+    if (symbol_Lookup(name) >= 0) {
+        return 1;
+    }
+    int count = __atomic_load_n(&_decodedSymbols, __ATOMIC_RELAXED);
+    do {
+        if (count >= VALUE_DECODE_MAX_SYMBOLS) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&_decodedSymbols, &count, count + 1, 0,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return 1;
+}
+
+static Value *
+value_ReadBinary(const uint8_t **cursor, const uint8_t *end, int depth)
+{
+    uint64_t length;
+    if (*cursor >= end || depth > VALUE_DECODE_MAX_DEPTH) {
+        return NULL;
+    }
+    CoolValue type = (CoolValue) *(*cursor)++;
+    if (!value_ReadVarint(cursor, end, &length)) {
+        return NULL;
+    }
+
+    // Lists count values, which take at least two bytes each; everything
+    // else counts bytes
+    size_t remaining = (size_t) (end - *cursor);
+    int counted = type == CoolValue_Sexpr || type == CoolValue_Qexpr;
+    if (length > (counted ? remaining / 2 : remaining)) {
+        return NULL;
+    }
+
+    const uint8_t *data = *cursor;
+    if (!counted) {
+        *cursor += length;
+    }
+
+    switch (type) {
+        case CoolValue_Integer: {
+            if (length < 1 || data[0] > 1) {
+                return NULL;
+            }
+            int negative = data[0];
+            const uint8_t *magnitude = data + 1;
+            size_t count = length - 1;
+
+            if (count <= sizeof(unsigned long)) {
+                unsigned long x = 0;
+                for (size_t i = 0; i < count; i++) {
+                    x = (x << 8) | magnitude[i];
+                }
+                if (x <= LONG_MAX) {
+                    return value_Integer(negative ? -(long) x : (long) x);
+                } else if (negative && x == (unsigned long) LONG_MAX + 1) {
+                    return value_Integer(LONG_MIN);
+                }
+            }
+
+            Value *result = value_Integer(0);
+            value_IntegerPromote(result);
+            mpz_import(result->bignumber, count, 1, 1, 1, 0, magnitude);
+            if (negative) {
+                mpz_neg(result->bignumber, result->bignumber);
+            }
+            return value_IntegerNormalize(result);
+        }
+        case CoolValue_Double: {
+            if (length != 8) {
+                return NULL;
+            }
+            uint64_t bits = 0;
+            for (int i = 0; i < 8; i++) {
+                bits |= (uint64_t) data[i] << (8 * i);
+            }
+            double x;
+            memcpy(&x, &bits, sizeof(x));
+            return value_Double(x);
+        }
+        case CoolValue_Byte:
+            return length == 1 ? value_Byte(data[0]) : NULL;
+        case CoolValue_String:
+        case CoolValue_Error:
+        case CoolValue_Symbol: {
+            if (memchr(data, '\0', length) != NULL) {
+                return NULL;
+            }
+            char *string = (char *) malloc(length + 1);
+            memcpy(string, data, length);
+            string[length] = '\0';
+
+            Value *result = NULL;
+            if (type == CoolValue_String) {
+                result = value_String(string);
+            } else if (type == CoolValue_Error) {
+                result = value_Error("%s", string);
+            } else if (value_MayInternSymbol(string)) {
+                result = value_Symbol(string);
+            }
+            free(string);
+            return result;
+        }
+        case CoolValue_Bytes:
+            return value_Bytes((uint8_t *) data, length);
+        case CoolValue_Sexpr:
+        case CoolValue_Qexpr: {
+            Value *result = type == CoolValue_Sexpr ? value_SExpr() : value_QExpr();
+            if (length > 0) {
+                value_ReserveCells(result, (int) length);
+            }
+            for (uint64_t i = 0; i < length; i++) {
+                Value *cell = value_ReadBinary(cursor, end, depth + 1);
+                if (cell == NULL) {
+                    value_Delete(result);
+                    return NULL;
+                }
+                result = value_AddCell(result, cell);
+            }
+            return result;
+        }
+        default:
+            return NULL;
+    }
+}
+
+// Encode value in the binary wire format, or return NULL if it has no encoding
+CBuffer *
+value_Encode(Value *value)
+{
+    CBuffer *buffer = cbuffer_Create();
+    if (!value_ToBinary(value, buffer)) {
+        cbuffer_Delete(&buffer);
     }
+    return buffer;
+}
 
+// Decode one value in the binary wire format, or return NULL unless data
+// holds exactly one well-formed value
+Value *
+value_Decode(const uint8_t *data, size_t length)
+{
+    const uint8_t *cursor = data;
+    Value *result = value_ReadBinary(&cursor, data + length, 0);
+    if (result != NULL && cursor != data + length) {
+        value_Delete(result);
+        return NULL;
+    }
     return result;
 }
 
 Value *
 value_ReadContent(char *contentName)
 {
-    FILE *fp = fopen(contentName, "r");
+    FILE *fp = fopen(contentName, "rb");
     if (fp == NULL) {
         // TODO: insert interest issuance here
         return value_Error("Unable to open file %s", contentName);
     } else {
-        Value *value = value_SExpr();
-        char fileBuffer[FILE_BLOCK_SIZE]; // read in FILE_BLOCK_SIZE-byte blocks
-        size_t numBytesRead = 0;
-        for (;;) {
-            numBytesRead = fread(fileBuffer, 1, FILE_BLOCK_SIZE, fp);
-
-            // Copy fileBuffer bytes to the value list
-            int start = value->count;
-
-            value->count += numBytesRead;
-            value->cell = realloc(value->cell, sizeof(Value *) * value->count);
+        // Size the store from the file length when we can, so a regular file
+        // is read into exactly as much memory as it needs; grow it only for
+        // streams of unknown length, or a file that grew since it was measured
+        size_t capacity = FILE_BLOCK_SIZE;
+        if (fseek(fp, 0, SEEK_END) == 0) {
+            long fileSize = ftell(fp);
+            if (fileSize > 0) {
+                capacity = (size_t) fileSize;
+            }
+            rewind(fp);
+        }
 
-            for (int i = 0; i < numBytesRead; i++) {
-                int index = start + i;
-                value->cell[index] = value_Byte(fileBuffer[i]);
+        ByteStore *store = byteStore_Create(capacity);
+        size_t length = 0;
+        for (;;) {
+            length += fread(store->data + length, 1, store->capacity - length, fp);
+            if (length < store->capacity) {
+                break; // a short read is the end of the file
             }
 
-            // Reset the file buffer (to zeros) and check to see if we're done
-            memset(fileBuffer, 0, FILE_BLOCK_SIZE);
-            if (numBytesRead != FILE_BLOCK_SIZE) {
+            // Full: only make room if there is more to come
+            int next = fgetc(fp);
+            if (next == EOF) {
                 break;
             }
+            store = (ByteStore *) realloc(store, sizeof(ByteStore) + 2 * store->capacity);
+            store->capacity *= 2;
+            store->data[length++] = (uint8_t) next;
         }
-        return value;
+        fclose(fp);
+
+        return value_BytesFromStore(store, 0, length);
     }
 }
 
@@ -568,8 +1629,12 @@ value_WriteContent(char *contentName, Value *data)
         // TODO: insert interest issuance here
         return value_Error("Unable to open file %s", contentName);
     } else {
-        for (int i = 0; i < data->count; i++) {
-            fputc(data->cell[i]->byte, fp);
+        if (data->type == CoolValue_Bytes) {
+            fwrite(value_BytesData(data), 1, data->bytes.length, fp);
+        } else {
+            for (int i = 0; i < data->count; i++) {
+                fputc(data->cell[i]->byte, fp);
+            }
         }
         fclose(fp);
         return value_SExpr();
@@ -579,16 +1644,29 @@ value_WriteContent(char *contentName, Value *data)
 void
 value_Delete(Value *value)
 {
+    // The last owner can skip the atomic decrement; nobody else can race with it.
+    // The acquire pairs with other owners' decrements, which may be on other threads.
+    if (__atomic_load_n(&value->refcount, __ATOMIC_ACQUIRE) > 1 && __sync_sub_and_fetch(&value->refcount, 1) > 0) {
+        return;
+    }
+
     switch (value->type) {
         case CoolValue_Actor:
-            free(value->symbolString);
             break;
         case CoolValue_Integer:
-            mpz_clear(value->bignumber);
+            if (value->isBig) {
+                mpz_clear(value->bignumber);
+            }
             break;
         case CoolValue_Double:
         case CoolValue_Byte:
             break;
+        case CoolValue_Bytes:
+            byteStore_Release(value->bytes.store);
+            break;
+        case CoolValue_Future:
+            future_Release(value->future);
+            break;
         case CoolValue_String:
             free(value->string);
             break;
@@ -596,25 +1674,27 @@ value_Delete(Value *value)
             free(value->errorString);
             break;
         case CoolValue_Symbol:
-            free(value->symbolString);
             break;
         case CoolValue_Sexpr:
         case CoolValue_Qexpr:
             for (int i = 0; i < value->count; i++) {
                 value_Delete(value->cell[i]);
             }
-            free(value->cell);
+            slab_Free(value->cell - value->offset, sizeof(Value *) * value->capacity);
             break;
         case CoolValue_Function:
             if (value->builtin == NULL) {
                 environment_Delete(value->env);
                 value_Delete(value->formals);
                 value_Delete(value->body);
+                if (value->code != NULL) {
+                    code_Release(value->code);
+                }
             }
             break;
     }
 
-    free(value);
+    slab_Free(value, sizeof(Value));
 }
 
 void
@@ -635,7 +1715,11 @@ value_Print(FILE* out, Value *value)
 {
     switch (value->type) {
         case CoolValue_Integer: {
-            mpz_out_str(out, 10, value->bignumber);
+            if (value->isBig) {
+                mpz_out_str(out, 10, value->bignumber);
+            } else {
+                fprintf(out, "%ld", value->fixnumber);
+            }
             break;
         }
         case CoolValue_Double:
@@ -644,6 +1728,15 @@ value_Print(FILE* out, Value *value)
         case CoolValue_Byte:
             fprintf(out, "%x", value->byte);
             break;
+        case CoolValue_Bytes: {
+            uint8_t *data = value_BytesData(value);
+            fprintf(out, "<");
+            for (size_t i = 0; i < value->bytes.length; i++) {
+                fprintf(out, "%02x", data[i]);
+            }
+            fprintf(out, ">");
+            break;
+        }
         case CoolValue_String:
             fprintf(out, "'%s'", value->string);
             break;
@@ -653,6 +1746,9 @@ value_Print(FILE* out, Value *value)
         case CoolValue_Symbol:
             fprintf(out, "%s", value->symbolString);
             break;
+        case CoolValue_Future:
+            fprintf(out, future_IsDone(value->future) ? "<future: done>" : "<future>");
+            break;
         case CoolValue_Sexpr:
             value_PrintExpr(out, value, "(", ")");
             break;
@@ -680,18 +1776,40 @@ value_Println(FILE *out, Value *value)
     fprintf(out, "\n");
 }
 
+Value *
+value_Retain(Value *value)
+{
+    __sync_fetch_and_add(&value->refcount, 1);
+    return value;
+}
+
+// Values are shared by reference once created, so anything that needs to
+// mutate one must take a private copy first. The copy is shallow: children
+// are shared and get copied themselves only when they are mutated.
+Value *
+value_Unshare(Value *value)
+{
+    if (__atomic_load_n(&value->refcount, __ATOMIC_ACQUIRE) == 1) {
+        return value;
+    }
+    Value *copy = value_Copy(value);
+    value_Delete(value);
+    return copy;
+}
+
 Value *
 value_Copy(Value *in)
 {
-    Value *copy = (Value *) malloc(sizeof(Value));
+    Value *copy = (Value *) slab_Allocate(sizeof(Value));
     copy->type = in->type;
+    copy->refcount = 1;
 
     switch (in->type) {
         case CoolValue_Actor:
             copy->env = environment_Copy(in->env);
             copy->actor = in->actor; // TODO: implement actor copy
-            copy->symbolString = (char *) malloc((strlen(in->symbolString) + 1) * sizeof(char));
-            strcpy(copy->symbolString, in->symbolString);
+            copy->symbol = in->symbol;
+            copy->symbolString = in->symbolString;
             break;
         case CoolValue_Function:
             if (in->builtin != NULL) {
@@ -699,16 +1817,29 @@ value_Copy(Value *in)
             } else {
                 copy->builtin = NULL;
                 copy->env = environment_Copy(in->env);
-                copy->formals = value_Copy(in->formals);
-                copy->body = value_Copy(in->body);
+                copy->formals = value_Retain(in->formals);
+                copy->body = value_Retain(in->body);
+                copy->code = in->code != NULL ? code_Retain(in->code) : NULL;
             }
             break;
         case CoolValue_Integer:
-            mpz_init(copy->bignumber);
-            mpz_set(copy->bignumber, in->bignumber);
+            copy->isBig = in->isBig;
+            if (in->isBig) {
+                mpz_init_set(copy->bignumber, in->bignumber);
+            } else {
+                copy->fixnumber = in->fixnumber;
+            }
+            break;
         case CoolValue_Byte:
             copy->byte = in->byte;
             break;
+        case CoolValue_Bytes:
+            __sync_fetch_and_add(&in->bytes.store->refcount, 1);
+            copy->bytes = in->bytes;
+            break;
+        case CoolValue_Future:
+            copy->future = future_Retain(in->future);
+            break;
         case CoolValue_Double:
             copy->fpnumber = in->fpnumber;
             break;
@@ -721,15 +1852,17 @@ value_Copy(Value *in)
             strcpy(copy->errorString, in->errorString);
             break;
         case CoolValue_Symbol:
-            copy->symbolString = (char *) malloc((strlen(in->symbolString) + 1) * sizeof(char));
-            strcpy(copy->symbolString, in->symbolString);
+            copy->symbol = in->symbol;
+            copy->symbolString = in->symbolString;
             break;
         case CoolValue_Sexpr:
         case CoolValue_Qexpr:
             copy->count = in->count;
-            copy->cell = (Value **) malloc(sizeof(Value *) * copy->count);
+            copy->cell = (Value **) slab_Allocate(sizeof(Value *) * copy->count);
+            copy->offset = 0;
+            copy->capacity = copy->count;
             for (int i = 0; i < copy->count; i++) {
-                copy->cell[i] = value_Copy(in->cell[i]);
+                copy->cell[i] = value_Retain(in->cell[i]);
             }
             break;
     }
@@ -737,21 +1870,53 @@ value_Copy(Value *in)
     return copy;
 }
 
+// Make room for count cells. Space freed by pops at the front is reused
+// once it is at least half the allocation, otherwise the cells grow
+// geometrically.
+void
+value_ReserveCells(Value *value, int count)
+{
+    if (value->offset + count <= value->capacity) {
+        return;
+    }
+
+    Value **base = value->cell - value->offset;
+    if (count <= value->capacity / 2) {
+        if (value->count > 0) {
+            memmove(base, value->cell, sizeof(Value *) * value->count);
+        }
+    } else {
+        int capacity = value->capacity < 4 ? 4 : 2 * value->capacity;
+        while (capacity < count) {
+            capacity *= 2;
+        }
+        Value **cells = (Value **) slab_Allocate(sizeof(Value *) * capacity);
+        // An empty list may have no cells at all yet
+        if (value->count > 0) {
+            memcpy(cells, value->cell, sizeof(Value *) * value->count);
+        }
+        slab_Free(base, sizeof(Value *) * value->capacity);
+        base = cells;
+        value->capacity = capacity;
+    }
+    value->cell = base;
+    value->offset = 0;
+}
+
 Value *
 value_AddCell(Value *value, Value *x)
 {
-    value->count++;
-    value->cell = realloc(value->cell, sizeof(Value *) * value->count);
-    value->cell[value->count - 1] = x;
+    value = value_Unshare(value);
+    value_ReserveCells(value, value->count + 1);
+    value->cell[value->count++] = x;
     return value;
 }
 
 Value *
 value_ReadInteger(mpc_ast_t* t)
 {
-    Value *val = value_Integer(0);
-    mpz_init_set_str(val->bignumber, t->contents, 10); // assumes decimal notation
-    return val;
+    Value *val = value_IntegerFromString(t->contents); // assumes decimal notation
+    return val != NULL ? val : value_Error("Invalid number: %s", t->contents);
 }
 
 Value *
@@ -837,16 +2002,20 @@ Value *
 value_Pop(Value *value, int i)
 {
     Value *x = value->cell[i];
-    memmove(&value->cell[i], &value->cell[i + 1], sizeof(Value *) * (value->count - 1));
+    if (i == 0) {
+        value->cell++;
+        value->offset++;
+    } else {
+        memmove(&value->cell[i], &value->cell[i + 1], sizeof(Value *) * (value->count - i - 1));
+    }
     value->count--;
-    value->cell = realloc(value->cell, sizeof(Value *) * value->count);
     return x;
 }
 
 Value *
 value_Take(Value *value, int i)
 {
-    Value *x = value_Pop(value, i);
+    Value *x = value_Retain(value->cell[i]);
     value_Delete(value);
     return x;
 }
@@ -854,13 +2023,59 @@ value_Take(Value *value, int i)
 Value *
 value_Join(Value *x, Value *y)
 {
-    while (y->count > 0) {
-        x = value_AddCell(x, value_Pop(y, 0));
+    x = value_Unshare(x);
+    value_ReserveCells(x, x->count + y->count);
+    for (int i = 0; i < y->count; i++) {
+        x->cell[x->count++] = value_Retain(y->cell[i]);
     }
     value_Delete(y);
     return x;
 }
 
+// True if count arguments bind every formal of a lambda with no rest parameter
+int
+value_IsSaturated(Value *function, int count)
+{
+    if (function->formals->count != count) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (function->formals->cell[i]->symbol == SymbolID_Ampersand) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Build a frame holding the lambda's bindings with args bound to its
+// formals. The arguments are borrowed; the frame takes its own references.
+Environment *
+value_BindFrame(Value *function, Value **args, int count)
+{
+    Environment *frame = environment_Copy(function->env);
+    frame->parent = NULL;
+    frame->root = frame;
+    for (int i = 0; i < count; i++) {
+        environment_PutKeyValue(frame, function->formals->cell[i], args[i]);
+    }
+    return frame;
+}
+
+// Run a saturated lambda in a fresh frame below env
+Value *
+value_CallFrame(Environment *env, Value *function, Value **args, int count)
+{
+    Code *code = value_Compile(function);
+
+    Environment *frame = value_BindFrame(function, args, count);
+    environment_SetParent(frame, env);
+
+    Value *result = code_Execute(code, frame);
+    environment_Delete(frame);
+
+    return result;
+}
+
 Value *
 value_Call(Environment *env, Value *function, Value *x)
 {
@@ -869,25 +2084,42 @@ value_Call(Environment *env, Value *function, Value *x)
         return val;
     }
 
+    if (value_IsSaturated(function, x->count)) {
+        Value *result = value_CallFrame(env, function, x->cell, x->count);
+        value_Delete(x);
+        return result;
+    }
+
+    // Compile before copying so the code is kept with the original lambda
+    value_Compile(function);
+
+    // Binding arguments consumes formals, so work on a private copy of the function
+    function = value_Copy(function);
+    function->formals = value_Unshare(function->formals);
+
     int given = x->count;
     int total = function->formals->count;
 
     while (x->count > 0) {
         if (function->formals->count == 0) {
             value_Delete(x);
+            value_Delete(function);
             return value_Error("Function was given too many arguments. Got %d, expected %d", given, total);
         }
 
         Value *symbol = value_Pop(function->formals, 0);
 
-        if (strcmp(symbol->symbolString, "&") == 0) {
+        if (symbol->symbol == SymbolID_Ampersand) {
             if (function->formals->count != 1) {
                 value_Delete(x);
+                value_Delete(symbol);
+                value_Delete(function);
                 return value_Error("Function format invalid. ", "Symbol '&' not followed by single symbol.");
             }
 
             Value* nsym = value_Pop(function->formals, 0);
-            environment_PutKeyValue(function->env, nsym, builtin_List(env, x));
+            x = builtin_List(env, x);
+            environment_PutKeyValue(function->env, nsym, x);
             value_Delete(symbol);
             value_Delete(nsym);
             break;
@@ -903,8 +2135,9 @@ value_Call(Environment *env, Value *function, Value *x)
 
     value_Delete(x);
 
-    if (function->formals->count > 0 && strcmp(function->formals->cell[0]->symbolString, "&") == 0) {
+    if (function->formals->count > 0 && function->formals->cell[0]->symbol == SymbolID_Ampersand) {
         if (function->formals->count != 2) {
+            value_Delete(function);
             return value_Error("Function format invalid. ", "Symbol '&' not followed by single symbol.");
         }
 
@@ -919,11 +2152,12 @@ value_Call(Environment *env, Value *function, Value *x)
     }
 
     if (function->formals->count == 0) {
-        function->env->parent = env;
-        Value *newFunctionBody = value_AddCell(value_SExpr(), value_Copy(function->body));
-        return builtin_Eval(function->env, newFunctionBody);
+        environment_SetParent(function->env, env);
+        Value *result = code_Execute(function->code, function->env);
+        value_Delete(function);
+        return result;
     } else {
-        return value_Copy(function);
+        return function;
     }
 }
 
@@ -993,13 +2227,19 @@ Value *
 builtin_Head(Environment *env, Value *x)
 {
     CASSERT(x, x->count == 1, "Function 'head' passed to many arguments, got %d", x->count);
+
+    if (x->cell[0]->type == CoolValue_Bytes) {
+        CASSERT(x, x->cell[0]->bytes.length > 0, "Function 'head' passed empty bytes");
+        Value *head = value_BytesSlice(x->cell[0], 0, 1);
+        value_Delete(x);
+        return head;
+    }
+
     CASSERT(x, x->cell[0]->type == CoolValue_Qexpr, "Function 'head' passed incorrect type, got %s", value_TypeString(x->cell[0]->type));
     CASSERT(x, x->cell[0]->count > 0, "Function 'head' passed {}, got %d", x->cell[0]->count);
 
-    Value *head = value_Take(x, 0); // pull out the list argument
-    while (head->count > 1) {
-        value_Delete(value_Pop(head, 1)); // delete all elements after the head
-    }
+    Value *head = value_AddCell(value_QExpr(), value_Retain(x->cell[0]->cell[0]));
+    value_Delete(x);
 
     return head;
 }
@@ -1008,10 +2248,18 @@ Value *
 builtin_Tail(Environment *env, Value *x)
 {
     CASSERT(x, x->count == 1, "Function 'head' passed to many arguments, got %d", x->count);
+
+    if (x->cell[0]->type == CoolValue_Bytes) {
+        CASSERT(x, x->cell[0]->bytes.length > 0, "Function 'tail' passed empty bytes");
+        Value *tail = value_BytesSlice(x->cell[0], 1, x->cell[0]->bytes.length - 1);
+        value_Delete(x);
+        return tail;
+    }
+
     CASSERT(x, x->cell[0]->type == CoolValue_Qexpr, "Function 'tail' passed incorrect type, got %s", value_TypeString(x->cell[0]->type));
     CASSERT(x, x->cell[0]->count > 0, "Function 'head' passed {}, got %d", x->cell[0]->count);
 
-    Value *head = value_Take(x, 0);
+    Value *head = value_Unshare(value_Take(x, 0));
     value_Delete(value_Pop(head, 0));
     Value *tail = head;
 
@@ -1021,6 +2269,7 @@ builtin_Tail(Environment *env, Value *x)
 Value *
 builtin_List(Environment *env, Value *x)
 {
+    x = value_Unshare(x);
     x->type = CoolValue_Qexpr;
     return x;
 }
@@ -1032,7 +2281,7 @@ builtin_Eval(Environment *env, Value *x)
     CASSERT(x, x->cell[0]->type == CoolValue_Qexpr, "Function 'eval' passed incorrect type, got %s", value_TypeString(x->cell[0]->type));
 
     // pop the head and evaluate it
-    Value *head = value_Take(x, 0);
+    Value *head = value_Unshare(value_Take(x, 0));
     head->type = CoolValue_Sexpr;
 
     Value *evalResult = value_Eval(env, head);
@@ -1040,9 +2289,33 @@ builtin_Eval(Environment *env, Value *x)
     return evalResult;
 }
 
+Value *
+builtin_JoinBytes(Environment *env, Value *x)
+{
+    size_t length = 0;
+    for (int i = 0; i < x->count; i++) {
+        CASSERT(x, x->cell[i]->type == CoolValue_Bytes, "Function 'join' passed incorrect type, got %s", value_TypeString(x->cell[i]->type));
+        length += x->cell[i]->bytes.length;
+    }
+
+    ByteStore *store = byteStore_Create(length);
+    size_t offset = 0;
+    for (int i = 0; i < x->count; i++) {
+        memcpy(store->data + offset, value_BytesData(x->cell[i]), x->cell[i]->bytes.length);
+        offset += x->cell[i]->bytes.length;
+    }
+
+    value_Delete(x);
+    return value_BytesFromStore(store, 0, length);
+}
+
 Value *
 builtin_Join(Environment *env, Value *x)
 {
+    if (x->count > 0 && x->cell[0]->type == CoolValue_Bytes) {
+        return builtin_JoinBytes(env, x);
+    }
+
     for (int i = 0; i < x->count; i++) {
         CASSERT(x, x->cell[i]->type == CoolValue_Qexpr, "Function 'join' passed incorrect type, got %s", x->cell[i]->type);
     }
@@ -1061,36 +2334,53 @@ builtin_Join(Environment *env, Value *x)
 Value *
 builtin_Encode(Environment *env, Value *x)
 {
-    CASSERT(x, x->count == 1, "Function 'encode' passed too many arguments, got %d", x->count);
+    CASSERT(x, x->count == 1 || x->count == 2, "Function 'encode' passed incorrect number of arguments, got %d", x->count);
 
-    cJSON *encodedForm = value_ToJSON(x->cell[0]);
-    if (encodedForm != NULL) {
-        char *stringForm = cJSON_Print(encodedForm);
-        Value *result = value_String(stringForm);
-        free(stringForm);
-        return result;
-    } else {
-        return value_Error("Unable to encode the value");
-    }
-}
+    // JSON, as a string, unless the binary format is asked for
+    if (x->count == 2) {
+        CASSERT(x, x->cell[1]->type == CoolValue_String, "Function 'encode' passed incorrect type for the format, got %s",
+            value_TypeString(x->cell[1]->type));
+        CASSERT(x, strcmp(x->cell[1]->string, "json") == 0 || strcmp(x->cell[1]->string, "binary") == 0,
+            "Function 'encode' passed unknown format '%s', expected json or binary", x->cell[1]->string);
 
-Value *
-builtin_Decode(Environment *env, Value *x)
-{
-    CASSERT(x, x->count == 1, "Function 'decode' passed too many arguments, got %d", x->count);
-    CASSERT(x, x->cell[0]->type == CoolValue_String, "Function 'decode' passed incorrect type, got %s", value_TypeString(x->cell[0]->type));
+        if (strcmp(x->cell[1]->string, "binary") == 0) {
+            CBuffer *encodedForm = value_Encode(x->cell[0]);
+            value_Delete(x);
+            if (encodedForm == NULL) {
+                return value_Error("Unable to encode the value");
+            }
+            Value *result = value_Bytes(cbuffer_GetBytes(encodedForm), cbuffer_GetLength(encodedForm));
+            cbuffer_Delete(&encodedForm);
+            return result;
+        }
+    }
 
-    cJSON *encodedForm = cJSON_Parse(x->cell[0]->string);
+    CBuffer *encodedForm = value_EncodeJSON(x->cell[0]);
+    value_Delete(x);
     if (encodedForm != NULL) {
-        Value *result = value_FromJSON(encodedForm);
-        cJSON_Delete(encodedForm);
-        value_Println(stdout, result);
+        Value *result = value_String((char *) cbuffer_GetBytes(encodedForm));
+        cbuffer_Delete(&encodedForm);
         return result;
     } else {
-        return value_Error("Unable to decode the value");
+        return value_Error("Unable to encode the value");
     }
 }
 
+Value *
+builtin_Decode(Environment *env, Value *x)
+{
+    CASSERT(x, x->count == 1, "Function 'decode' passed too many arguments, got %d", x->count);
+    CASSERT(x, x->cell[0]->type == CoolValue_String || x->cell[0]->type == CoolValue_Bytes,
+        "Function 'decode' passed incorrect type, got %s", value_TypeString(x->cell[0]->type));
+
+    // Bytes hold the binary format, strings JSON
+    Value *result = x->cell[0]->type == CoolValue_Bytes
+        ? value_Decode(value_BytesData(x->cell[0]), x->cell[0]->bytes.length)
+        : value_DecodeJSON(x->cell[0]->string);
+    value_Delete(x);
+    return result != NULL ? result : value_Error("Unable to decode the value");
+}
+
 int
 value_Equal(Value *x, Value *y)
 {
@@ -1100,15 +2390,20 @@ value_Equal(Value *x, Value *y)
 
     switch (x->type) {
         case CoolValue_Integer:
-            return mpz_cmp(x->bignumber, y->bignumber) == 0;
+            return value_IntegerCompare(x, y) == 0;
         case CoolValue_Byte:
             return x->byte == y->byte;
+        case CoolValue_Bytes:
+            return x->bytes.length == y->bytes.length
+                && memcmp(value_BytesData(x), value_BytesData(y), x->bytes.length) == 0;
         case CoolValue_Double:
             return x->fpnumber == y->fpnumber;
         case CoolValue_String:
             return (strcmp(x->string, y->string) == 0);
         case CoolValue_Symbol:
-            return (strcmp(x->symbolString, y->symbolString) == 0);
+            return x->symbol == y->symbol;
+        case CoolValue_Future:
+            return x->future == y->future;
         case CoolValue_Error:
             return (strcmp(x->errorString, y->errorString) == 0);
         case CoolValue_Function:
@@ -1161,13 +2456,13 @@ builtin_IntegerOrder(Environment *env, Value *x, char *operator)
     int ret = 0;
 
     if (strcmp(operator, ">") == 0) {
-        ret = mpz_cmp(x->cell[0]->bignumber, x->cell[1]->bignumber) > 0 ? 1 : -1;
+        ret = value_IntegerCompare(x->cell[0], x->cell[1]) > 0 ? 1 : -1;
     } else if (strcmp(operator, "<") == 0) {
-        ret = mpz_cmp(x->cell[0]->bignumber, x->cell[1]->bignumber) < 0 ? 1 : -1;
+        ret = value_IntegerCompare(x->cell[0], x->cell[1]) < 0 ? 1 : -1;
     } else if (strcmp(operator, ">=") == 0) {
-        ret = mpz_cmp(x->cell[0]->bignumber, x->cell[1]->bignumber) >= 0 ? 1 : -1;
+        ret = value_IntegerCompare(x->cell[0], x->cell[1]) >= 0 ? 1 : -1;
     } else if (strcmp(operator, "<=") == 0) {
-        ret = mpz_cmp(x->cell[0]->bignumber, x->cell[1]->bignumber) <= 0 ? 1 : -1;
+        ret = value_IntegerCompare(x->cell[0], x->cell[1]) <= 0 ? 1 : -1;
     } else {
         value_Delete(x);
         return value_Error("Error: unexpected operator in 'builtin_Order': %s", operator);
@@ -1255,79 +2550,232 @@ builtin_If(Environment *env, Value *x)
     CASSERT_TYPE("if", x, 1, CoolValue_Qexpr);
     CASSERT_TYPE("if", x, 2, CoolValue_Qexpr);
 
-    Value *y;
-    x->cell[1]->type = CoolValue_Sexpr;
-    x->cell[2]->type = CoolValue_Sexpr;
+    Value *branch = value_Unshare(value_Pop(x, value_IntegerSign(x->cell[0]) > 0 ? 1 : 2));
+    branch->type = CoolValue_Sexpr;
+    value_Delete(x);
 
-    if (mpz_sgn(x->cell[0]->bignumber) > 0) {
-        y = value_Eval(env, value_Pop(x, 1));
-    } else {
-        y = value_Eval(env, value_Pop(x, 2));
+    return value_Eval(env, branch);
+}
+
+int
+operator_AddFixnum(long a, long b, long *result)
+{
+    return !__builtin_add_overflow(a, b, result);
+}
+
+int
+operator_SubFixnum(long a, long b, long *result)
+{
+    return !__builtin_sub_overflow(a, b, result);
+}
+
+int
+operator_MulFixnum(long a, long b, long *result)
+{
+    return !__builtin_mul_overflow(a, b, result);
+}
+
+int
+operator_DivFixnum(long a, long b, long *result)
+{
+    if (b == 0 || (a == LONG_MIN && b == -1)) {
+        return 0;
+    }
+    *result = a / b;
+    if ((a % b != 0) && ((a < 0) != (b < 0))) { // floor, like mpz_div
+        (*result)--;
     }
+    return 1;
+}
 
-    value_Delete(x);
-    return y;
+int
+operator_XorFixnum(long a, long b, long *result)
+{
+    *result = a ^ b;
+    return 1;
 }
 
-Value *
-builtin_Operator(Environment *env, Value *expr, char* op)
+int
+operator_PowFixnum(long a, long b, long *result)
 {
-    for (int i = 0; i < expr->count; i++) {
-        if (expr->cell[i]->type != CoolValue_Integer && expr->cell[i]->type != CoolValue_Double) {
-            value_Delete(expr);
-            return value_Error("Cannot operate on a non-number, got type %s", value_TypeString(expr->cell[i]->type));
+    if (b < 0) {
+        return 0;
+    }
+    long power = 1;
+    while (b > 0) {
+        if ((b & 1) && __builtin_mul_overflow(power, a, &power)) {
+            return 0;
+        }
+        b >>= 1;
+        if (b > 0 && __builtin_mul_overflow(a, a, &a)) {
+            return 0;
         }
     }
+    *result = power;
+    return 1;
+}
+
+void
+operator_PowBignum(mpz_ptr result, mpz_srcptr a, mpz_srcptr b)
+{
+    mpz_pow_ui(result, a, mpz_get_ui(b));
+}
 
-    Value *x = value_Pop(expr, 0);
-    if ((strcmp(op, "-") == 0) && expr->count == 0) {
-        mpz_t zero;
-        mpz_init(zero);
-        mpz_add_ui(zero, zero, 0);
-        mpz_sub(x->bignumber, zero, x->bignumber);
+double
+operator_AddDouble(double a, double b)
+{
+    return a + b;
+}
+
+double
+operator_SubDouble(double a, double b)
+{
+    return a - b;
+}
+
+double
+operator_MulDouble(double a, double b)
+{
+    return a * b;
+}
+
+double
+operator_DivDouble(double a, double b)
+{
+    return a / b;
+}
+
+OperatorKernel operator_Add = { "+", operator_AddFixnum, mpz_add, operator_AddDouble, 0 };
+OperatorKernel operator_Sub = { "-", operator_SubFixnum, mpz_sub, operator_SubDouble, 0 };
+OperatorKernel operator_Mul = { "*", operator_MulFixnum, mpz_mul, operator_MulDouble, 0 };
+OperatorKernel operator_Div = { "/", operator_DivFixnum, mpz_fdiv_q, operator_DivDouble, 1 };
+OperatorKernel operator_Xor = { "^", operator_XorFixnum, mpz_xor, NULL, 0 };
+OperatorKernel operator_Pow = { "**", operator_PowFixnum, operator_PowBignum, pow, 0 };
+
+double
+value_ToDouble(Value *value)
+{
+    if (value->type == CoolValue_Double) {
+        return value->fpnumber;
+    } else if (value->isBig) {
+        return mpz_get_d(value->bignumber);
+    } else {
+        return (double) value->fixnumber;
     }
+}
 
-    while (expr->count > 0) {
-        Value *y = value_Pop(expr, 0);
-        if (strcmp(op, "+") == 0) {
-            mpz_add(x->bignumber, x->bignumber, y->bignumber);
-        }
-        if (strcmp(op, "-") == 0) {
-            mpz_sub(x->bignumber, x->bignumber, y->bignumber);
-        }
-        if (strcmp(op, "*") == 0) {
-            mpz_mul(x->bignumber, x->bignumber, y->bignumber);
+Value *
+builtin_DoubleOperator(Environment *env, Value *expr, OperatorKernel *op)
+{
+    CASSERT(expr, op->fpnumber != NULL, "Operator '%s' cannot operate on a double", op->name);
+
+    double result = value_ToDouble(expr->cell[0]);
+    if (op == &operator_Sub && expr->count == 1) {
+        result = -result;
+    }
+
+    for (int i = 1; i < expr->count; i++) {
+        double y = value_ToDouble(expr->cell[i]);
+        CASSERT(expr, !op->checkZero || y != 0.0, "Division by zero.");
+        result = op->fpnumber(result, y);
+    }
+
+    value_Delete(expr);
+    return value_Double(result);
+}
+
+Value *
+builtin_IntegerOperator(Environment *env, Value *expr, OperatorKernel *op)
+{
+    // Accumulate in a fixnum until a result overflows, then in an mpz_t
+    Value *x = expr->cell[0];
+    long fixnumber = x->fixnumber;
+    int isBig = x->isBig;
+    mpz_t bignumber;
+    if (isBig) {
+        mpz_init_set(bignumber, x->bignumber);
+    }
+
+    if (op == &operator_Sub && expr->count == 1) {
+        if (!isBig && fixnumber != LONG_MIN) {
+            fixnumber = -fixnumber;
+        } else {
+            if (!isBig) {
+                mpz_init_set_si(bignumber, fixnumber);
+                isBig = 1;
+            }
+            mpz_neg(bignumber, bignumber);
         }
-        if (strcmp(op, "/") == 0) {
-            if (mpz_sgn(y->bignumber) == 0) {
-                value_Delete(x);
-                value_Delete(y);
-                x = value_Error("Division by zero.");
-                break;
+    }
+
+    for (int i = 1; i < expr->count; i++) {
+        Value *y = expr->cell[i];
+        if (op->checkZero && value_IntegerSign(y) == 0) {
+            if (isBig) {
+                mpz_clear(bignumber);
             }
-            mpz_div(x->bignumber, x->bignumber, y->bignumber);
+            value_Delete(expr);
+            return value_Error("Division by zero.");
         }
 
-        // TODO: AND mpz_and
-        // TODO: SETBIT mpz_setbit
-        // TODO: CLRBIT mpz_clrbit
-        // TODO: TSTBIT mpz_tstbit
-        // TODO: FLIPBIT mpz_combit
+        long result;
+        if (!isBig && !y->isBig && op->fixnum(fixnumber, y->fixnumber, &result)) {
+            fixnumber = result;
+            continue;
+        }
 
-        if (strcmp(op, "^") == 0) {
-            mpz_xor(x->bignumber, x->bignumber, y->bignumber);
+        if (!isBig) {
+            mpz_init_set_si(bignumber, fixnumber);
+            isBig = 1;
         }
-        if (strcmp(op, "**") == 0) {
-            mpz_pow_ui(x->bignumber, x->bignumber, mpz_get_ui(y->bignumber));
+        if (y->isBig) {
+            op->bignum(bignumber, bignumber, y->bignumber);
+        } else {
+            mpz_t operand;
+            mpz_init_set_si(operand, y->fixnumber);
+            op->bignum(bignumber, bignumber, operand);
+            mpz_clear(operand);
         }
-        value_Delete(y);
     }
 
     value_Delete(expr);
-    return x;
+
+    Value *value = value_Integer(fixnumber);
+    if (isBig) {
+        value->isBig = 1;
+        mpz_init(value->bignumber);
+        mpz_swap(value->bignumber, bignumber);
+        mpz_clear(bignumber);
+        value_IntegerNormalize(value);
+    }
+    return value;
+}
+
+// Operands are used in place; any Double makes the whole expression Double
+Value *
+builtin_Operator(Environment *env, Value *expr, OperatorKernel *op)
+{
+    CASSERT(expr, expr->count > 0, "Operator '%s' passed no arguments", op->name);
+
+    int isDouble = 0;
+    for (int i = 0; i < expr->count; i++) {
+        if (expr->cell[i]->type == CoolValue_Double) {
+            isDouble = 1;
+        } else if (expr->cell[i]->type != CoolValue_Integer) {
+            Value *error = value_Error("Cannot operate on a non-number, got type %s", value_TypeString(expr->cell[i]->type));
+            value_Delete(expr);
+            return error;
+        }
+    }
+
+    if (isDouble) {
+        return builtin_DoubleOperator(env, expr, op);
+    } else {
+        return builtin_IntegerOperator(env, expr, op);
+    }
 }
 
-// TODO: this needs to change to accept a third parameter -- the callback function (which is invoked when the result is returned)
+// Returns a future for the reply; see `await`, `await-all` and `then`
 Value *
 builtin_SendAsync(Environment *env, Value *val)
 {
@@ -1338,16 +2786,140 @@ builtin_SendAsync(Environment *env, Value *val)
     // Look up the string and gets the actor value
     Value *lookupSymbol = value_Symbol(val->cell[0]->string);
     Value *actorWrapper = environment_Get(env, lookupSymbol);
+    value_Delete(lookupSymbol);
 
+    Value *result;
     if (actorWrapper->type == CoolValue_Actor) {
-        cJSON *encodedMessage = value_ToJSON(val->cell[1]);
-        actor_SendMessageAsync(actorWrapper->actor, encodedMessage);
+        // Values are immutable once shared, so the actor can use ours as is
+        Future *future = future_Create((void (*)(void *)) value_Delete);
+        if (actor_SendMessageAsync(actorWrapper->actor, value_Retain(val->cell[1]), future_Retain(future))) {
+            result = value_Future(future);
+        } else {
+            future_Release(future);
+            result = value_Error("Mailbox of actor '%s' is full", val->cell[0]->string);
+        }
     } else {
         // TODO: issue the interest here
-        return value_Error("Invalid type returned when indexing into the Actor\n");
+        result = value_Error("Invalid type returned when indexing into the Actor\n");
     }
 
-    return value_SExpr();
+    value_Delete(actorWrapper);
+    value_Delete(val);
+    return result;
+}
+
+Value *
+builtin_Await(Environment *env, Value *x)
+{
+    CASSERT_NUM("await", x, 1);
+    CASSERT(x, x->cell[0]->type == CoolValue_Future, "Function 'await' passed incorrect type, got %s, expected %s",
+        value_TypeString(x->cell[0]->type), value_TypeString(CoolValue_Future));
+
+    Value *result = (Value *) future_Wait(x->cell[0]->future);
+    result = result != NULL ? value_Retain(result) : value_Error("Message was dropped from a full mailbox");
+
+    value_Delete(x);
+    return result;
+}
+
+// Waits for every future in a Q-expression and returns their results in order
+Value *
+builtin_AwaitAll(Environment *env, Value *x)
+{
+    CASSERT_NUM("await-all", x, 1);
+    CASSERT(x, x->cell[0]->type == CoolValue_Qexpr, "Function 'await-all' passed incorrect type, got %s, expected %s",
+        value_TypeString(x->cell[0]->type), value_TypeString(CoolValue_Qexpr));
+
+    Value *futures = x->cell[0];
+    for (int i = 0; i < futures->count; i++) {
+        CASSERT(x, futures->cell[i]->type == CoolValue_Future, "Function 'await-all' passed incorrect type, got %s, expected %s",
+            value_TypeString(futures->cell[i]->type), value_TypeString(CoolValue_Future));
+    }
+
+    Value *results = value_QExpr();
+    value_ReserveCells(results, futures->count);
+    for (int i = 0; i < futures->count; i++) {
+        Value *result = (Value *) future_Wait(futures->cell[i]->future);
+        results = value_AddCell(results, result != NULL ? value_Retain(result) : value_Error("Message was dropped from a full mailbox"));
+    }
+
+    value_Delete(x);
+    return results;
+}
+
+static void
+continuation_Run(SchedulerTask *task)
+{
+    Continuation *continuation = (Continuation *) task;
+
+    Value *args = value_AddCell(value_SExpr(), continuation->argument);
+    Value *result = value_Call(continuation->env, continuation->function, args);
+    future_Complete(continuation->future, result);
+
+    future_Release(continuation->future);
+    value_Delete(continuation->function);
+    environment_Delete(continuation->env);
+    free(continuation);
+}
+
+// Runs on the thread that completed the future, so hand the work to the scheduler
+static void
+continuation_Schedule(void *context, void *result)
+{
+    Continuation *continuation = (Continuation *) context;
+    continuation->argument = result != NULL
+        ? value_Retain((Value *) result)
+        : value_Error("Message was dropped from a full mailbox");
+    scheduler_Submit(&continuation->task);
+}
+
+// syntax: then <future> <function>, returns a future for the function's result
+Value *
+builtin_Then(Environment *env, Value *x)
+{
+    CASSERT_NUM("then", x, 2);
+    CASSERT(x, x->cell[0]->type == CoolValue_Future, "Function 'then' passed incorrect type, got %s, expected %s",
+        value_TypeString(x->cell[0]->type), value_TypeString(CoolValue_Future));
+    CASSERT(x, x->cell[1]->type == CoolValue_Function, "Function 'then' passed incorrect type, got %s, expected %s",
+        value_TypeString(x->cell[1]->type), value_TypeString(CoolValue_Function));
+
+    // The lambda may run after this call frame is gone, so it gets its own
+    // global environment over the shared snapshot, as `run` tasks do
+    Continuation *continuation = (Continuation *) malloc(sizeof(Continuation));
+    continuation->task.run = continuation_Run;
+    continuation->env = environment_Share(env->root);
+    continuation->function = value_Retain(x->cell[1]);
+    continuation->argument = NULL;
+    continuation->future = future_Create((void (*)(void *)) value_Delete);
+
+    Value *result = value_Future(future_Retain(continuation->future));
+    future_Then(x->cell[0]->future, continuation_Schedule, continuation);
+
+    value_Delete(x);
+    return result;
+}
+
+// syntax: queue-depth <name>, the number of messages waiting for the actor
+Value *
+builtin_QueueDepth(Environment *env, Value *val)
+{
+    CASSERT_NUM("queue-depth", val, 1);
+    CASSERT_TYPE("queue-depth", val, 0, CoolValue_String);
+
+    Value *lookupSymbol = value_Symbol(val->cell[0]->string);
+    Value *actorWrapper = environment_Get(env, lookupSymbol);
+    value_Delete(lookupSymbol);
+
+    Value *result;
+    if (actorWrapper->type == CoolValue_Actor) {
+        result = value_Integer(actor_GetQueueDepth(actorWrapper->actor));
+    } else {
+        result = value_Error("'%s' is not an actor", val->cell[0]->string);
+    }
+
+    value_Delete(actorWrapper);
+    value_Delete(val);
+    return result;
 }
 
 Value *
@@ -1359,53 +2931,70 @@ builtin_SendSync(Environment *env, Value *val)
 
     Value *lookupSymbol = value_Symbol(val->cell[0]->string);
     Value *actorWrapper = environment_Get(env, lookupSymbol);
+    value_Delete(lookupSymbol);
 
+    Value *result;
     if (actorWrapper->type == CoolValue_Actor) {
-        cJSON *encodedMessage = value_ToJSON(val->cell[1]);
-        Value *result = (Value *) actor_SendMessageSync(actorWrapper->actor, encodedMessage);
-        return result;
+        // Values are immutable once shared, so the actor can use ours as is
+        result = (Value *) actor_SendMessageSync(actorWrapper->actor, value_Retain(val->cell[1]));
+        if (result == NULL) {
+            result = value_Error("Mailbox of actor '%s' is full", val->cell[0]->string);
+        }
     } else {
-        cJSON *encodedMessage = value_ToJSON(val->cell[1]);
-        cJSON *response = ccnFetcher_Fetch(env->fetcher, val->cell[0]->string, encodedMessage);
-        Value *result = value_FromJSON(response);
-        return result;
+        CBuffer *encodedMessage = value_Encode(val->cell[1]);
+        CBuffer *response = encodedMessage != NULL
+            ? ccnFetcher_Fetch(env->fetcher, val->cell[0]->string, encodedMessage) : NULL;
+        result = response != NULL ? value_Decode(cbuffer_GetBytes(response), cbuffer_GetLength(response)) : NULL;
+        if (result == NULL) {
+            result = value_Error("No reply from actor '%s'", val->cell[0]->string);
+        }
+        if (encodedMessage != NULL) {
+            cbuffer_Delete(&encodedMessage);
+        }
+        if (response != NULL) {
+            cbuffer_Delete(&response);
+        }
     }
+
+    value_Delete(actorWrapper);
+    value_Delete(val);
+    return result;
 }
 
 Value *
 builtin_add(Environment *env, Value *val)
 {
-    return builtin_Operator(env, val, "+");
+    return builtin_Operator(env, val, &operator_Add);
 }
 
 Value *
 builtin_sub(Environment *env, Value *val)
 {
-    return builtin_Operator(env, val, "-");
+    return builtin_Operator(env, val, &operator_Sub);
 }
 
 Value *
 builtin_mul(Environment *env, Value *val)
 {
-    return builtin_Operator(env, val, "*");
+    return builtin_Operator(env, val, &operator_Mul);
 }
 
 Value *
 builtin_div(Environment *env, Value *val)
 {
-    return builtin_Operator(env, val, "/");
+    return builtin_Operator(env, val, &operator_Div);
 }
 
 Value *
 builtin_xor(Environment *env, Value *val)
 {
-    return builtin_Operator(env, val, "^");
+    return builtin_Operator(env, val, &operator_Xor);
 }
 
 Value *
 builtin_exp(Environment *env, Value *val)
 {
-    return builtin_Operator(env, val, "**");
+    return builtin_Operator(env, val, &operator_Pow);
 }
 
 Value *
@@ -1483,45 +3072,122 @@ builtin_Write(Environment *env, Value *x)
 {
     CASSERT_NUM("write", x, 2);
     CASSERT_TYPE("write", x, 0, CoolValue_String);
-    CASSERT_TYPE("write", x, 1, CoolValue_Sexpr);
+    CASSERT(x, x->cell[1]->type == CoolValue_Bytes || x->cell[1]->type == CoolValue_Sexpr || x->cell[1]->type == CoolValue_Qexpr,
+        "Function 'write' passed incorrect type for argument 1. Got %s, Expected %s.",
+        value_TypeString(x->cell[1]->type), value_TypeString(CoolValue_Bytes));
     Value *bytesWritten = value_WriteContent(x->cell[0]->string, x->cell[1]);
     value_Delete(x);
     return bytesWritten;
 }
 
+static void
+runTask_Run(SchedulerTask *task)
+{
+    RunTask *run = (RunTask *) task;
+
+    Value *result = value_EvaluateExpression(run->env, run->expression);
+    future_Complete(run->future, result);
+
+    future_Release(run->future);
+    environment_Delete(run->env);
+    free(run);
+}
+
+// syntax: run <function> <args...>, calls the function on the scheduler's
+// workers and returns a future for its result
 Value *
-value_EvaluateExpressionWrapper(EvaluateWrapper *wrapper)
+builtin_Run(Environment *env, Value *x)
 {
-    Value *result = value_EvaluateExpression(wrapper->env, wrapper->param);
+    RunTask *run = (RunTask *) malloc(sizeof(RunTask));
+    run->task.run = runTask_Run;
+    run->env = environment_Share(env);
+    run->expression = x;
+    run->future = future_Create((void (*)(void *)) value_Delete);
+
+    Value *result = value_Future(future_Retain(run->future));
+    scheduler_Submit(&run->task);
     return result;
 }
 
+// Read the optional arguments of spawn and service:
+// <capacity> bounds each mailbox (0 for none) and <policy> is "block",
+// "drop-oldest" or "error"; <replicas> runs that many copies of the
+// function under one name, shared out by <dispatch>, which is
+// "round-robin", "least-loaded" or "work-sharing". Returns an error, or
+// NULL if they are valid.
 Value *
-builtin_Run(Environment *env, Value *x)
+value_SpawnOptions(char *func, Value *x, SpawnOptions *options)
 {
-    pthread_t runner;
-    EvaluateWrapper *wrapper = (EvaluateWrapper *) malloc(sizeof(EvaluateWrapper));
-    wrapper->env = environment_Copy(env);
-    wrapper->param = value_Copy(x);
-    if (pthread_create(&runner, NULL, (void *(*)(void *)) value_EvaluateExpressionWrapper, wrapper)) {
-        return value_Error("Error creating thread runner");
+    options->capacity = 0;
+    options->policy = ActorMailbox_Block;
+    options->replicas = 1;
+    options->dispatch = ActorPool_RoundRobin;
+
+    if (x->count < 2 || x->count > 6) {
+        return value_Error("Function '%s' passed incorrect number of arguments. Got %i, Expected 2 to 6.", func, x->count);
     }
-    return value_SExpr();
+
+    for (int i = 2; i < x->count; i += 2) {
+        Value *size = x->cell[i];
+        if (size->type != CoolValue_Integer || size->isBig || size->fixnumber < (i == 2 ? 0 : 1)) {
+            return value_Error(i == 2 ? "Function '%s' expects a non-negative mailbox capacity"
+                : "Function '%s' expects a positive number of replicas", func);
+        }
+        if (i == 2) {
+            options->capacity = (size_t) size->fixnumber;
+        } else {
+            options->replicas = (size_t) size->fixnumber;
+        }
+
+        if (i + 1 == x->count) {
+            break;
+        }
+        Value *name = x->cell[i + 1];
+        if (name->type != CoolValue_String) {
+            return value_Error("Function '%s' passed incorrect type for argument %i. Got %s, Expected %s.",
+                func, i + 1, value_TypeString(name->type), value_TypeString(CoolValue_String));
+        }
+
+        if (i == 2 && strcmp(name->string, "block") == 0) {
+            options->policy = ActorMailbox_Block;
+        } else if (i == 2 && strcmp(name->string, "drop-oldest") == 0) {
+            options->policy = ActorMailbox_DropOldest;
+        } else if (i == 2 && strcmp(name->string, "error") == 0) {
+            options->policy = ActorMailbox_Error;
+        } else if (i == 2) {
+            return value_Error("Unknown mailbox policy '%s', expected 'block', 'drop-oldest' or 'error'", name->string);
+        } else if (strcmp(name->string, "round-robin") == 0) {
+            options->dispatch = ActorPool_RoundRobin;
+        } else if (strcmp(name->string, "least-loaded") == 0) {
+            options->dispatch = ActorPool_LeastLoaded;
+        } else if (strcmp(name->string, "work-sharing") == 0) {
+            options->dispatch = ActorPool_WorkSharing;
+        } else {
+            return value_Error("Unknown dispatch '%s', expected 'round-robin', 'least-loaded' or 'work-sharing'", name->string);
+        }
+    }
+
+    return NULL;
 }
 
 Value *
 builtin_SpawnLocal(Environment *env, Value *x)
 {
-    CASSERT_NUM("spawn", x, 2);
+    SpawnOptions options;
+    Value *error = value_SpawnOptions("spawn", x, &options);
+    if (error != NULL) {
+        value_Delete(x);
+        return error;
+    }
     CASSERT_TYPE("spawn", x, 0, CoolValue_String);
     CASSERT_TYPE("spawn", x, 1, CoolValue_Function);
 
-    // syntax: spawn <name> <function>
-    Value *actorWrapper = value_ActorLocal(env, x->cell[1]);
-    actorWrapper->symbolString = (char *) malloc((strlen(x->cell[0]->string) + 1) * sizeof(char));
-    strcpy(actorWrapper->symbolString, x->cell[0]->string);
-
-    Value *actorKey = value_Symbol(actorWrapper->symbolString);
+    // syntax: spawn <name> <function> [<capacity> [<policy> [<replicas> [<dispatch>]]]]
+    Value *actorWrapper = value_ActorLocal(env, x->cell[1], options.replicas, options.dispatch);
+    actor_SetMailbox(actorWrapper->actor, options.capacity, options.policy);
+    Value *actorKey = value_Symbol(x->cell[0]->string);
+    actorWrapper->symbol = actorKey->symbol;
+    actorWrapper->symbolString = actorKey->symbolString;
     environment_DefineKeyValue(env, actorKey, actorWrapper);
 
     actor_Start(actorWrapper->actor);
@@ -1532,16 +3198,21 @@ builtin_SpawnLocal(Environment *env, Value *x)
 Value *
 builtin_SpawnGlobal(Environment *env, Value *x)
 {
-    CASSERT_NUM("service", x, 2);
+    SpawnOptions options;
+    Value *error = value_SpawnOptions("service", x, &options);
+    if (error != NULL) {
+        value_Delete(x);
+        return error;
+    }
     CASSERT_TYPE("service", x, 0, CoolValue_String);
     CASSERT_TYPE("service", x, 1, CoolValue_Function);
 
-    // syntax: spawn <name> <function>
-    Value *actorWrapper = value_ActorGlobal(env, x->cell[1], x->cell[0]->string);
-    actorWrapper->symbolString = (char *) malloc((strlen(x->cell[0]->string) + 1) * sizeof(char));
-    strcpy(actorWrapper->symbolString, x->cell[0]->string);
-
-    Value *actorKey = value_Symbol(actorWrapper->symbolString);
+    // syntax: service <name> <function> [<capacity> [<policy> [<replicas> [<dispatch>]]]]
+    Value *actorWrapper = value_ActorGlobal(env, x->cell[1], x->cell[0]->string, options.replicas, options.dispatch);
+    actor_SetMailbox(actorWrapper->actor, options.capacity, options.policy);
+    Value *actorKey = value_Symbol(x->cell[0]->string);
+    actorWrapper->symbol = actorKey->symbol;
+    actorWrapper->symbolString = actorKey->symbolString;
     environment_DefineKeyValue(env, actorKey, actorWrapper);
 
     actor_Start(actorWrapper->actor);
@@ -1596,6 +3267,10 @@ environment_AddBuiltinFunctions(Environment *env)
 
     environment_AddBuiltin(env, "<!", builtin_SendAsync);
     environment_AddBuiltin(env, "<-", builtin_SendSync);
+    environment_AddBuiltin(env, "queue-depth", builtin_QueueDepth);
+    environment_AddBuiltin(env, "await", builtin_Await);
+    environment_AddBuiltin(env, "await-all", builtin_AwaitAll);
+    environment_AddBuiltin(env, "then", builtin_Then);
     environment_AddBuiltin(env, "+", builtin_add);
     environment_AddBuiltin(env, "-", builtin_sub);
     environment_AddBuiltin(env, "*", builtin_mul);
@@ -1604,9 +3279,422 @@ environment_AddBuiltinFunctions(Environment *env)
     environment_AddBuiltin(env, "**", builtin_exp);
 }
 
+Code *
+code_Retain(Code *code)
+{
+    __sync_fetch_and_add(&code->refcount, 1);
+    return code;
+}
+
+void
+code_Release(Code *code)
+{
+    if (__sync_sub_and_fetch(&code->refcount, 1) > 0) {
+        return;
+    }
+    for (int i = 0; i < code->constantCount; i++) {
+        value_Delete(code->constants[i]);
+    }
+    free(code->constants);
+    free(code->instructions);
+    free(code);
+}
+
+typedef struct {
+    Code *code;
+    int instructionCapacity;
+    int constantCapacity;
+    int depth;
+
+    // Frame slots in the order a call binds them: closed-over bindings, then formals
+    SymbolID *slots;
+    int slotCount;
+} CodeBuilder;
+
+int
+code_Emit(CodeBuilder *builder, CoolOp op, int a, int b)
+{
+    Code *code = builder->code;
+    if (code->length + 3 > builder->instructionCapacity) {
+        builder->instructionCapacity = builder->instructionCapacity == 0 ? 48 : 2 * builder->instructionCapacity;
+        code->instructions = (int *) realloc(code->instructions, sizeof(int) * builder->instructionCapacity);
+    }
+
+    int at = code->length;
+    code->instructions[at] = op;
+    code->instructions[at + 1] = a;
+    code->instructions[at + 2] = b;
+    code->length += 3;
+
+    if (op == CoolOp_Constant || op == CoolOp_Lookup) {
+        builder->depth++;
+    } else if (op == CoolOp_Call || op == CoolOp_TailCall) {
+        builder->depth -= a;
+    } else if (op == CoolOp_If) {
+        builder->depth -= 2;
+    }
+    if (builder->depth > code->stackSize) {
+        code->stackSize = builder->depth;
+    }
+
+    return at;
+}
+
+int
+code_AddConstant(CodeBuilder *builder, Value *value)
+{
+    Code *code = builder->code;
+    if (code->constantCount == builder->constantCapacity) {
+        builder->constantCapacity = builder->constantCapacity == 0 ? 8 : 2 * builder->constantCapacity;
+        code->constants = (Value **) realloc(code->constants, sizeof(Value *) * builder->constantCapacity);
+    }
+    code->constants[code->constantCount] = value_Retain(value);
+    return code->constantCount++;
+}
+
+int
+code_FindSlot(CodeBuilder *builder, SymbolID symbol)
+{
+    for (int i = 0; i < builder->slotCount; i++) {
+        if (builder->slots[i] == symbol) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void code_CompileValue(CodeBuilder *builder, Value *value, int tail);
+
+// Compile the cells of an S-expression the way value_EvaluateExpression runs
+// them. A call in tail position is the last thing the body does.
+void
+code_CompileExpression(CodeBuilder *builder, Value *expr, int tail)
+{
+    if (expr->count == 0) {
+        Value *empty = value_SExpr();
+        code_Emit(builder, CoolOp_Constant, code_AddConstant(builder, empty), 0);
+        value_Delete(empty);
+        return;
+    }
+
+    if (expr->count == 1) {
+        code_CompileValue(builder, expr->cell[0], tail);
+        return;
+    }
+
+    // (if test {then} {else}) branches inline, as long as 'if' still names the builtin
+    Value *head = expr->cell[0];
+    if (expr->count == 4 && head->type == CoolValue_Symbol && strcmp(head->symbolString, "if") == 0
+            && expr->cell[2]->type == CoolValue_Qexpr && expr->cell[3]->type == CoolValue_Qexpr) {
+        code_CompileValue(builder, head, 0);
+        code_CompileValue(builder, expr->cell[1], 0);
+        int branch = code_Emit(builder, CoolOp_If, 0, 0);
+
+        code_CompileExpression(builder, expr->cell[2], tail);
+        int thenJump = code_Emit(builder, CoolOp_Jump, 0, 0);
+
+        builder->depth--;
+        builder->code->instructions[branch + 1] = builder->code->length;
+        code_CompileExpression(builder, expr->cell[3], tail);
+        int elseJump = code_Emit(builder, CoolOp_Jump, 0, 0);
+
+        builder->depth++;
+        builder->code->instructions[branch + 2] = builder->code->length;
+        code_Emit(builder, CoolOp_Constant, code_AddConstant(builder, expr->cell[2]), 0);
+        code_Emit(builder, CoolOp_Constant, code_AddConstant(builder, expr->cell[3]), 0);
+        code_Emit(builder, CoolOp_Call, 3, 0);
+
+        builder->code->instructions[thenJump + 1] = builder->code->length;
+        builder->code->instructions[elseJump + 1] = builder->code->length;
+        return;
+    }
+
+    for (int i = 0; i < expr->count; i++) {
+        code_CompileValue(builder, expr->cell[i], 0);
+    }
+    code_Emit(builder, tail ? CoolOp_TailCall : CoolOp_Call, expr->count - 1, 0);
+}
+
+void
+code_CompileValue(CodeBuilder *builder, Value *value, int tail)
+{
+    if (value->type == CoolValue_Symbol) {
+        code_Emit(builder, CoolOp_Lookup, code_AddConstant(builder, value), code_FindSlot(builder, value->symbol));
+    } else if (value->type == CoolValue_Sexpr) {
+        code_CompileExpression(builder, value, tail);
+    } else {
+        code_Emit(builder, CoolOp_Constant, code_AddConstant(builder, value), 0);
+    }
+}
+
+Code *
+code_Compile(Value *function)
+{
+    CodeBuilder builder;
+    builder.code = (Code *) calloc(1, sizeof(Code));
+    builder.code->refcount = 1;
+    builder.instructionCapacity = 0;
+    builder.constantCapacity = 0;
+    builder.depth = 0;
+
+    builder.slots = (SymbolID *) malloc(sizeof(SymbolID) * (function->env->count + function->formals->count + 1));
+    builder.slotCount = 0;
+    for (int i = 0; i < function->env->count; i++) {
+        builder.slots[builder.slotCount++] = function->env->symbols[i];
+    }
+    for (int i = 0; i < function->formals->count; i++) {
+        SymbolID symbol = function->formals->cell[i]->symbol;
+        if (symbol != SymbolID_Ampersand && code_FindSlot(&builder, symbol) < 0) {
+            builder.slots[builder.slotCount++] = symbol;
+        }
+    }
+
+    code_CompileExpression(&builder, function->body, 1);
+    code_Emit(&builder, CoolOp_Return, 0, 0);
+
+    free(builder.slots);
+    return builder.code;
+}
+
+Code *
+value_Compile(Value *function)
+{
+    if (function->code == NULL) {
+        Code *code = code_Compile(function);
+        if (!__sync_bool_compare_and_swap(&function->code, NULL, code)) {
+            code_Release(code); // another thread got there first
+        }
+    }
+    return function->code;
+}
+
+// Integer arithmetic and comparisons on two fixnums, without building an
+// argument list. Returns NULL when the builtin has to run.
+Value *
+code_CallInline(cbuiltin builtin, Value *x, Value *y)
+{
+    if (x->type != CoolValue_Integer || x->isBig || y->type != CoolValue_Integer || y->isBig) {
+        return NULL;
+    }
+
+    long a = x->fixnumber;
+    long b = y->fixnumber;
+    long result;
+
+    if (builtin == builtin_add) {
+        if (__builtin_add_overflow(a, b, &result)) {
+            return NULL;
+        }
+    } else if (builtin == builtin_sub) {
+        if (__builtin_sub_overflow(a, b, &result)) {
+            return NULL;
+        }
+    } else if (builtin == builtin_mul) {
+        if (__builtin_mul_overflow(a, b, &result)) {
+            return NULL;
+        }
+    } else if (builtin == builtin_lt) {
+        result = a < b ? 1 : -1;
+    } else if (builtin == builtin_gt) {
+        result = a > b ? 1 : -1;
+    } else if (builtin == builtin_lte) {
+        result = a <= b ? 1 : -1;
+    } else if (builtin == builtin_gte) {
+        result = a >= b ? 1 : -1;
+    } else if (builtin == builtin_Equal) {
+        result = a == b;
+    } else if (builtin == builtin_NotEqual) {
+        result = a != b;
+    } else {
+        return NULL;
+    }
+
+    return value_Integer(result);
+}
+
+// Apply values[0] to the count values after it, consuming all of them
+Value *
+code_Call(Environment *env, Value **values, int count)
+{
+    for (int i = 0; i <= count; i++) {
+        if (values[i]->type == CoolValue_Error) {
+            Value *error = values[i];
+            for (int j = 0; j <= count; j++) {
+                if (j != i) {
+                    value_Delete(values[j]);
+                }
+            }
+            return error;
+        }
+    }
+
+    Value *function = values[0];
+    if (function->type != CoolValue_Function) {
+        Value *error = value_Error("S-expression does not start with a function, got type %s", value_TypeString(function->type));
+        for (int i = 0; i <= count; i++) {
+            value_Delete(values[i]);
+        }
+        return error;
+    }
+
+    Value *result = NULL;
+    if (function->builtin != NULL && count == 2) {
+        result = code_CallInline(function->builtin, values[1], values[2]);
+    } else if (function->builtin == NULL && value_IsSaturated(function, count)) {
+        result = value_CallFrame(env, function, &values[1], count);
+    }
+
+    if (result != NULL) {
+        for (int i = 0; i <= count; i++) {
+            value_Delete(values[i]);
+        }
+        return result;
+    }
+
+    Value *args = value_SExpr();
+    args->count = count;
+    args->cell = (Value **) slab_Allocate(sizeof(Value *) * count);
+    args->capacity = count;
+    memcpy(args->cell, &values[1], sizeof(Value *) * count);
+
+    result = value_Call(env, function, args);
+    value_Delete(function);
+
+    return result;
+}
+
+// A tail call can reuse the running loop when it saturates a lambda and
+// none of its values is an error
+int
+code_IsTailCall(Environment *env, Value **values, int count)
+{
+    Value *function = values[0];
+    if (env->parent == NULL || function->type != CoolValue_Function || function->builtin != NULL
+            || !value_IsSaturated(function, count)) {
+        return 0;
+    }
+    for (int i = 1; i <= count; i++) {
+        if (values[i]->type == CoolValue_Error) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+Value *
+code_Execute(Code *code, Environment *env)
+{
+    // Frame and code installed by tail calls, released when replaced or on return
+    Environment *tailFrame = NULL;
+    Code *tailCode = NULL;
+
+    int stackSize = code->stackSize;
+    Value **stack = (Value **) slab_Allocate(sizeof(Value *) * stackSize);
+    int sp = 0;
+    int *pc = code->instructions;
+
+    for (;;) {
+        switch (pc[0]) {
+            case CoolOp_Constant:
+                stack[sp++] = value_Retain(code->constants[pc[1]]);
+                break;
+            case CoolOp_Lookup: {
+                Value *symbol = code->constants[pc[1]];
+                int slot = pc[2];
+                if (slot >= 0 && slot < env->count && env->symbols[slot] == symbol->symbol) {
+                    stack[sp++] = value_Retain(env->values[slot]);
+                } else {
+                    stack[sp++] = environment_Get(env, symbol);
+                }
+                break;
+            }
+            case CoolOp_Call:
+                sp -= pc[1] + 1;
+                stack[sp] = code_Call(env, &stack[sp], pc[1]);
+                sp++;
+                break;
+            case CoolOp_TailCall: {
+                int count = pc[1];
+                sp -= count + 1;
+                if (!code_IsTailCall(env, &stack[sp], count)) {
+                    stack[sp] = code_Call(env, &stack[sp], count);
+                    sp++;
+                    break;
+                }
+                assert(sp == 0);
+
+                // With dynamic scoping the callee still sees this frame's bindings,
+                // but this frame never runs again. Fold them into the callee's frame
+                // below its own bindings and drop this one, so a loop written as
+                // tail recursion runs in constant space.
+                Value *function = stack[0];
+                Code *next = code_Retain(value_Compile(function));
+                Environment *frame = value_BindFrame(function, &stack[1], count);
+                for (int i = 0; i < env->count; i++) {
+                    if (environment_Find(frame, env->symbols[i]) < 0) {
+                        environment_Bind(frame, env->symbols[i], env->values[i]);
+                    }
+                }
+                environment_SetParent(frame, env->parent);
+
+                for (int i = 0; i <= count; i++) {
+                    value_Delete(stack[i]);
+                }
+                if (tailFrame != NULL) {
+                    environment_Delete(tailFrame);
+                    code_Release(tailCode);
+                }
+                env = tailFrame = frame;
+                code = tailCode = next;
+
+                if (code->stackSize > stackSize) {
+                    stack = (Value **) slab_Reallocate(stack, sizeof(Value *) * stackSize, sizeof(Value *) * code->stackSize);
+                    stackSize = code->stackSize;
+                }
+                pc = code->instructions;
+                continue;
+            }
+            case CoolOp_If: {
+                Value *function = stack[sp - 2];
+                Value *test = stack[sp - 1];
+                if (function->type != CoolValue_Function || function->builtin != builtin_If || test->type != CoolValue_Integer) {
+                    pc = code->instructions + pc[2];
+                    continue;
+                }
+
+                int sign = value_IntegerSign(test);
+                value_Delete(function);
+                value_Delete(test);
+                sp -= 2;
+                if (sign <= 0) {
+                    pc = code->instructions + pc[1];
+                    continue;
+                }
+                break;
+            }
+            case CoolOp_Jump:
+                pc = code->instructions + pc[1];
+                continue;
+            case CoolOp_Return: {
+                Value *result = stack[sp - 1];
+                slab_Free(stack, sizeof(Value *) * stackSize);
+                if (tailFrame != NULL) {
+                    environment_Delete(tailFrame);
+                    code_Release(tailCode);
+                }
+                return result;
+            }
+        }
+        pc += 3;
+    }
+}
+
 Value *
 value_EvaluateExpression(Environment *env, Value *value)
 {
+    // Cells are replaced with their results in place
+    value = value_Unshare(value);
+
     // Evaluate each expression
     for (int i = 0; i < value->count; i++) {
         value->cell[i] = value_Eval(env, value->cell[i]);
@@ -1629,9 +3717,10 @@ value_EvaluateExpression(Environment *env, Value *value)
 
     Value *funcSymbol = value_Pop(value, 0);
     if (funcSymbol->type != CoolValue_Function) {
+        Value *error = value_Error("S-expression does not start with a function, got type %s", value_TypeString(funcSymbol->type));
         value_Delete(funcSymbol);
         value_Delete(value);
-        return value_Error("S-expression does not start with a function, got type %s", value_TypeString(funcSymbol->type));
+        return error;
     }
 
     Value *result = value_Call(env, funcSymbol, value);
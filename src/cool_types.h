@@ -23,7 +23,9 @@ typedef enum {
     CoolValue_Qexpr,
     CoolValue_Function,
     CoolValue_Actor,
-    CoolValue_Error
+    CoolValue_Error,
+    CoolValue_Bytes,
+    CoolValue_Future
 } CoolValue;
 
 #endif // libcool_types_h_
@@ -1,28 +1,60 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../cool_types.h"
 #include "channel.h"
+#include "scheduler.h"
 #include "actor.h"
 
 #include "ccn/ccn_producer.h"
 
+// Messages a local actor handles before yielding its worker to other actors
+#define LOCAL_ACTOR_RUN_LIMIT 64
+
 typedef struct actor_message_queue ActorMessageQueue;
 
 static size_t _actorId;
 
 struct actor_message_queue {
     Channel *channel;
+
+    // Messages pushed and not yet handled, whether still queued or already
+    // taken in a batch by a replica that has yet to get to them
+    size_t pending;
 };
 
+// Local actors have no thread of their own. An actor is queued on the
+// scheduler when a message arrives in its empty mailbox, and runs on a
+// worker until the mailbox is drained.
 struct local_actor {
+    SchedulerTask task;
+    int scheduled; // 1 while queued or running
+
     ActorMessageQueue *inputQueue;
-    cJSON *(*callback)(void *metadata, cJSON *message);
+    ActorMailboxPolicy policy; // what a send does when the mailbox is full
+
+    // Replicas in a work-sharing pool share `inputQueue` and form a ring, so
+    // that a send can wake whichever of them is idle. A lone actor is a ring
+    // of one.
+    struct local_actor *sibling;
+    size_t sharers;
+
+    void *(*callback)(void *metadata, void *message);
+    void (*release)(void *reply);
     void *metadata;
 };
 typedef struct local_actor LocalActor;
 
+struct pool_actor {
+    Actor **replicas;
+    size_t count;
+    ActorPoolDispatch dispatch;
+    size_t next; // where the next round-robin or least-loaded search starts
+};
+typedef struct pool_actor PoolActor;
+
 struct global_actor {
     Actor *actor;
     CCNProducer *portal;
@@ -35,27 +67,49 @@ struct actor {
     ActorID id;
 };
 
-static cJSON *localActor_SendMessageSync(LocalActor *actor, cJSON *message);
-static cJSON *globalActor_SendMessageSync(GlobalActor *actor, cJSON *message);
-static void localActor_SendMessageAsync(LocalActor *actor, cJSON *message);
-static void globalActor_SendMessageAsync(GlobalActor *actor, cJSON *message);
+static void *localActor_SendMessageSync(LocalActor *actor, void *message);
+static void *globalActor_SendMessageSync(GlobalActor *actor, void *message);
+static int localActor_SendMessageAsync(LocalActor *actor, void *message, Future *future);
+static int globalActor_SendMessageAsync(GlobalActor *actor, void *message, Future *future);
+static void localActor_SetMailbox(LocalActor *actor, size_t capacity, ActorMailboxPolicy policy);
+static void globalActor_SetMailbox(GlobalActor *actor, size_t capacity, ActorMailboxPolicy policy);
+static size_t localActor_GetQueueDepth(LocalActor *actor);
+static size_t globalActor_GetQueueDepth(GlobalActor *actor);
+static void *poolActor_SendMessageSync(PoolActor *actor, void *message);
+static int poolActor_SendMessageAsync(PoolActor *actor, void *message, Future *future);
+static void poolActor_SetMailbox(PoolActor *actor, size_t capacity, ActorMailboxPolicy policy);
+static size_t poolActor_GetQueueDepth(PoolActor *actor);
+static void poolActor_Start(PoolActor *actor);
 static void globalActor_Start(GlobalActor *actor);
 static void localActor_Start(LocalActor *actor);
 static void globalActor_Run(GlobalActor *actor);
-static void localActor_Run(LocalActor *actor);
+static void localActor_Run(SchedulerTask *task);
 
 ActorInterface *LocalActorInterface = &(ActorInterface) {
     .start = (void (*)(void *)) localActor_Start,
     .getID = (ActorID (*)(void *)) actor_GetID,
-    .sendMessageAsync = (void (*)(void *, cJSON *)) localActor_SendMessageAsync,
-    .sendMessageSync = (cJSON *(*)(void *, cJSON *)) localActor_SendMessageSync
+    .sendMessageAsync = (int (*)(void *, void *, Future *)) localActor_SendMessageAsync,
+    .sendMessageSync = (void *(*)(void *, void *)) localActor_SendMessageSync,
+    .setMailbox = (void (*)(void *, size_t, ActorMailboxPolicy)) localActor_SetMailbox,
+    .getQueueDepth = (size_t (*)(void *)) localActor_GetQueueDepth
 };
 
 ActorInterface *GlobalActorInterface = &(ActorInterface) {
     .start = (void (*)(void *)) globalActor_Start,
     .getID = (ActorID (*)(void *)) actor_GetID,
-    .sendMessageAsync = (void (*)(void *, cJSON *)) globalActor_SendMessageAsync,
-    .sendMessageSync = (cJSON *(*)(void *, cJSON *)) globalActor_SendMessageSync
+    .sendMessageAsync = (int (*)(void *, void *, Future *)) globalActor_SendMessageAsync,
+    .sendMessageSync = (void *(*)(void *, void *)) globalActor_SendMessageSync,
+    .setMailbox = (void (*)(void *, size_t, ActorMailboxPolicy)) globalActor_SetMailbox,
+    .getQueueDepth = (size_t (*)(void *)) globalActor_GetQueueDepth
+};
+
+ActorInterface *PoolActorInterface = &(ActorInterface) {
+    .start = (void (*)(void *)) poolActor_Start,
+    .getID = (ActorID (*)(void *)) actor_GetID,
+    .sendMessageAsync = (int (*)(void *, void *, Future *)) poolActor_SendMessageAsync,
+    .sendMessageSync = (void *(*)(void *, void *)) poolActor_SendMessageSync,
+    .setMailbox = (void (*)(void *, size_t, ActorMailboxPolicy)) poolActor_SetMailbox,
+    .getQueueDepth = (size_t (*)(void *)) poolActor_GetQueueDepth
 };
 
 // TODO: implement this generic actor interface
@@ -72,10 +126,20 @@ ActorMessageQueue *
 ActorMessageQueue_Create()
 {
     ActorMessageQueue *queue = (ActorMessageQueue *) malloc(sizeof(ActorMessageQueue));
-    queue->channel = channel_Create();
+    queue->channel = channel_Create(NULL);
+    queue->pending = 0;
     return queue;
 }
 
+void
+ActorMessageQueue_Destroy(ActorMessageQueue **queueP)
+{
+    ActorMessageQueue *queue = *queueP;
+    channel_Destroy(&queue->channel);
+    free(queue);
+    *queueP = NULL;
+}
+
 ChannelMessage *
 ActorMessageQueue_PushMessage(ActorMessageQueue *queue, ChannelMessage *message)
 {
@@ -83,22 +147,52 @@ ActorMessageQueue_PushMessage(ActorMessageQueue *queue, ChannelMessage *message)
     return insertedMessage;
 }
 
+ChannelMessage *
+ActorMessageQueue_TryPushMessage(ActorMessageQueue *queue, ChannelMessage *message)
+{
+    return channel_TryEnqueue(queue->channel, message);
+}
+
 ChannelMessage *
 ActorMessageQueue_PopMessage(ActorMessageQueue *queue)
 {
     return channel_Dequeue(queue->channel);
 }
 
+ChannelMessage *
+ActorMessageQueue_TryPopMessage(ActorMessageQueue *queue)
+{
+    return channel_TryDequeue(queue->channel);
+}
+
+size_t
+ActorMessageQueue_TryPopMessages(ActorMessageQueue *queue, ChannelMessage **messages, size_t max)
+{
+    return channel_TryDequeueBatch(queue->channel, messages, max);
+}
+
+size_t
+ActorMessageQueue_GetSize(ActorMessageQueue *queue)
+{
+    return channel_GetSize(queue->channel);
+}
+
 Actor *
-actor_CreateLocal(void *callbackMetadata, cJSON *(*callback)(void *, cJSON *))
+actor_CreateLocal(void *callbackMetadata, void *(*callback)(void *, void *), void (*release)(void *))
 {
     Actor *actor = (Actor *) malloc(sizeof(Actor));
     volatile size_t inc = 1;
 
     LocalActor *localActor = (LocalActor *) malloc(sizeof(LocalActor));
 
+    localActor->task.run = localActor_Run;
+    localActor->scheduled = 0;
     localActor->inputQueue = ActorMessageQueue_Create();
+    localActor->policy = ActorMailbox_Block;
+    localActor->sibling = localActor;
+    localActor->sharers = 1;
     localActor->callback = callback;
+    localActor->release = release;
     localActor->metadata = callbackMetadata;
 
     actor->id = __sync_fetch_and_add(&_actorId, inc);
@@ -109,11 +203,19 @@ actor_CreateLocal(void *callbackMetadata, cJSON *(*callback)(void *, cJSON *))
 }
 
 Actor *
-actor_CreateGlobal(char *name, void *callbackMetadata, cJSON *(*callback)(void *, cJSON *))
+actor_CreateGlobal(char *name, void *callbackMetadata, void *(*callback)(void *, void *), void (*release)(void *),
+    CBuffer *(*encodedCallback)(void *, const uint8_t *, size_t))
+{
+    return actor_Publish(name, actor_CreateLocal(callbackMetadata, callback, release), callbackMetadata, encodedCallback);
+}
+
+Actor *
+actor_Publish(char *name, Actor *localActor, void *callbackMetadata,
+    CBuffer *(*encodedCallback)(void *, const uint8_t *, size_t))
 {
     GlobalActor *globalActor = (GlobalActor *) malloc(sizeof(GlobalActor));
-    globalActor->actor = actor_CreateLocal(callbackMetadata, callback);
-    globalActor->portal = ccnProducer_Create(name, callbackMetadata, callback);
+    globalActor->actor = localActor;
+    globalActor->portal = ccnProducer_Create(name, callbackMetadata, encodedCallback);
 
     Actor *actor = (Actor *) malloc(sizeof(Actor));
     volatile size_t inc = 1;
@@ -125,19 +227,172 @@ actor_CreateGlobal(char *name, void *callbackMetadata, cJSON *(*callback)(void *
     return actor;
 }
 
+Actor *
+actor_CreatePool(Actor **replicas, size_t count, ActorPoolDispatch dispatch)
+{
+    PoolActor *pool = (PoolActor *) malloc(sizeof(PoolActor));
+    pool->replicas = (Actor **) malloc(sizeof(Actor *) * count);
+    memcpy(pool->replicas, replicas, sizeof(Actor *) * count);
+    pool->count = count;
+    pool->dispatch = dispatch;
+    pool->next = 0;
+
+    if (dispatch == ActorPool_WorkSharing) {
+        LocalActor *first = (LocalActor *) replicas[0]->instance;
+        for (size_t i = 0; i < count; i++) {
+            LocalActor *replica = (LocalActor *) replicas[i]->instance;
+            if (replica != first) {
+                ActorMessageQueue_Destroy(&replica->inputQueue);
+                replica->inputQueue = first->inputQueue;
+            }
+            replica->sibling = (LocalActor *) replicas[(i + 1) % count]->instance;
+            replica->sharers = count;
+        }
+    }
+
+    Actor *actor = (Actor *) malloc(sizeof(Actor));
+    volatile size_t inc = 1;
+
+    actor->id = __sync_fetch_and_add(&_actorId, inc);
+    actor->instance = (void *) pool;
+    actor->interface = PoolActorInterface;
+
+    return actor;
+}
+
+// Queue the actor on the scheduler unless it is already queued or running.
+// In a work-sharing pool any idle replica will do.
 static void
-localActor_Run(LocalActor *actor)
+localActor_Wake(LocalActor *actor)
 {
-    for (;;) {
-        ChannelMessage *message = ActorMessageQueue_PopMessage(actor->inputQueue);
-        Signal *thesignal = channelMessage_GetSignal(message);
+    LocalActor *candidate = actor;
+    do {
+        if (__sync_bool_compare_and_swap(&candidate->scheduled, 0, 1)) {
+            scheduler_Submit(&candidate->task);
+            return;
+        }
+        candidate = candidate->sibling;
+    } while (candidate != actor);
+}
+
+// Throw away a message that will never be handled. Whoever is waiting for
+// its reply gets NULL.
+static void
+localActor_Discard(LocalActor *actor, ChannelMessage *message)
+{
+    actor->release(channelMessage_GetPayload(message));
+
+    Future *future = channelMessage_GetFuture(message);
+    if (channelMessage_HasWaiter(message)) {
+        channelMessage_Complete(message, NULL);
+    } else if (future != NULL) {
+        future_Complete(future, NULL);
+        future_Release(future);
+        channelMessage_Destroy(&message);
+    } else {
+        channelMessage_Destroy(&message);
+    }
+}
+
+// Put a message in the mailbox according to its policy. Returns 0, having
+// discarded the message, if it was refused.
+static int
+localActor_Push(LocalActor *actor, ChannelMessage *message)
+{
+    ActorMessageQueue *queue = actor->inputQueue;
+
+    // Counted before it is reachable, so a handler never uncounts a message
+    // that has not been counted yet
+    __atomic_add_fetch(&queue->pending, 1, __ATOMIC_RELAXED);
+
+    switch (actor->policy) {
+        case ActorMailbox_Block:
+            // On a worker only the sending fiber parks, and the worker goes
+            // on running other actors, usually including this one; other
+            // threads sleep until the actor makes room
+            while (ActorMessageQueue_TryPushMessage(queue, message) == NULL) {
+                localActor_Wake(actor);
+                if (scheduler_IsWorker()) {
+                    channel_ParkForSpace(queue->channel);
+                } else {
+                    channel_WaitForSpace(queue->channel);
+                }
+            }
+            break;
+        case ActorMailbox_DropOldest: {
+            ChannelMessage *dropped = channel_EnqueueDropOldest(queue->channel, message);
+            if (dropped != NULL) {
+                __atomic_sub_fetch(&queue->pending, 1, __ATOMIC_RELAXED);
+                localActor_Discard(actor, dropped);
+            }
+            break;
+        }
+        case ActorMailbox_Error:
+            if (ActorMessageQueue_TryPushMessage(queue, message) == NULL) {
+                __atomic_sub_fetch(&queue->pending, 1, __ATOMIC_RELAXED);
+                localActor_Discard(actor, message);
+                return 0;
+            }
+            break;
+    }
 
-        signal_Lock(thesignal);
-        cJSON *result = actor->callback(actor->metadata, channelMessage_GetPayload(message));
+    localActor_Wake(actor);
+    return 1;
+}
+
+static void
+localActor_Run(SchedulerTask *task)
+{
+    LocalActor *actor = (LocalActor *) task;
+    ChannelMessage *batch[LOCAL_ACTOR_RUN_LIMIT];
 
-        channelMessage_SetOutput(message, result);
-        signal_Notify(thesignal);
-        signal_Unlock(thesignal);
+    for (;;) {
+        // Take everything we will handle this turn at once, so a busy
+        // mailbox costs one trip through the consumer lock per batch. A
+        // replica sharing its mailbox takes only its share and calls in
+        // another replica for the rest.
+        size_t limit = LOCAL_ACTOR_RUN_LIMIT;
+        if (actor->sharers > 1) {
+            size_t share = ActorMessageQueue_GetSize(actor->inputQueue) / actor->sharers + 1;
+            limit = share < limit ? share : limit;
+        }
+        size_t count = ActorMessageQueue_TryPopMessages(actor->inputQueue, batch, limit);
+        if (actor->sharers > 1 && ActorMessageQueue_GetSize(actor->inputQueue) > 0) {
+            localActor_Wake(actor->sibling);
+        }
+        for (size_t i = 0; i < count; i++) {
+            ChannelMessage *message = batch[i];
+            void *result = actor->callback(actor->metadata, channelMessage_GetPayload(message));
+            // Uncount it before the reply goes out, so a sender that has
+            // its reply never sees this replica still busy with it
+            __atomic_sub_fetch(&actor->inputQueue->pending, 1, __ATOMIC_RELAXED);
+            Future *future = channelMessage_GetFuture(message);
+            if (channelMessage_HasWaiter(message)) {
+                channelMessage_Complete(message, result);
+            } else if (future != NULL) {
+                future_Complete(future, result);
+                future_Release(future);
+                channelMessage_Destroy(&message);
+            } else {
+                actor->release(result);
+                channelMessage_Destroy(&message);
+            }
+        }
+
+        // Still busy: go to the back of the run queue so other actors get a turn
+        if (ActorMessageQueue_GetSize(actor->inputQueue) > 0) {
+            scheduler_Submit(&actor->task);
+            return;
+        }
+
+        // A sender that saw scheduled == 1 did not wake us, so check again
+        // after going idle
+        __sync_lock_release(&actor->scheduled);
+        __sync_synchronize();
+        if (ActorMessageQueue_GetSize(actor->inputQueue) == 0
+                || !__sync_bool_compare_and_swap(&actor->scheduled, 0, 1)) {
+            return;
+        }
     }
 }
 
@@ -153,8 +408,9 @@ globalActor_Run(GlobalActor *actor)
 void
 localActor_Start(LocalActor *actor)
 {
-    pthread_t *t = (pthread_t *) malloc(sizeof(pthread_t));
-    pthread_create(t, NULL, (void *) &localActor_Run, (void *) actor);
+    if (ActorMessageQueue_GetSize(actor->inputQueue) > 0) {
+        localActor_Wake(actor);
+    }
 }
 
 void
@@ -164,46 +420,145 @@ globalActor_Start(GlobalActor *actor)
     pthread_create(t, NULL, (void *) &globalActor_Run, (void *) actor);
 }
 
+int
+globalActor_SendMessageAsync(GlobalActor *actor, void *message, Future *future)
+{
+    return actor_SendMessageAsync(actor->actor, message, future);
+}
+
+int
+localActor_SendMessageAsync(LocalActor *actor, void *message, Future *future)
+{
+    // Nobody waits on the message itself, so the actor frees it once it has
+    // been handled and the reply, if wanted, is in the future.
+    ChannelMessage *channelMessage = channelMessage_CreateFuture(message, future);
+    return localActor_Push(actor, channelMessage);
+}
+
+void *
+globalActor_SendMessageSync(GlobalActor *actor, void *message)
+{
+    return actor_SendMessageSync(actor->actor, message);
+}
+
+void *
+localActor_SendMessageSync(LocalActor *actor, void *message)
+{
+    ChannelMessage *channelMessage = channelMessage_CreateSync(message);
+    localActor_Push(actor, channelMessage);
+
+    // Refused or dropped messages are completed with NULL, so this returns
+    // straight away for them. A handler calling `<-` runs on a worker fiber,
+    // which is suspended until the reply arrives while the worker runs
+    // other actors.
+    return channelMessage_Wait(channelMessage);
+}
+
 void
-globalActor_SendMessageAsync(GlobalActor *actor, cJSON *message)
+localActor_SetMailbox(LocalActor *actor, size_t capacity, ActorMailboxPolicy policy)
 {
-    actor_SendMessageAsync(actor->actor, message);
+    channel_SetCapacity(actor->inputQueue->channel, capacity);
+    actor->policy = policy;
 }
 
-// TODO: this should take a callback as an argument (invoked with the output when complete)
 void
-localActor_SendMessageAsync(LocalActor *actor, cJSON *message)
+globalActor_SetMailbox(GlobalActor *actor, size_t capacity, ActorMailboxPolicy policy)
 {
-    // We ignore the signal that's returned since we are not waiting
-    // for it to complete.
-    ChannelMessage *channelMessage = channelMessage_Create(message);
-    Signal *thesignal = channelMessage_GetSignal(channelMessage);
-    signal_Lock(thesignal);
-    ActorMessageQueue_PushMessage(actor->inputQueue, channelMessage);
-    signal_Unlock(thesignal);
+    actor_SetMailbox(actor->actor, capacity, policy);
 }
 
-cJSON *
-globalActor_SendMessageSync(GlobalActor *actor, cJSON *message)
+size_t
+localActor_GetQueueDepth(LocalActor *actor)
 {
-    return actor_SendMessageSync(actor->actor, message);
+    return ActorMessageQueue_GetSize(actor->inputQueue);
+}
+
+// Messages queued for the actor or taken off its queue and not yet handled.
+// The queue depth alone misses a batch that a replica is working through.
+static size_t
+localActor_GetLoad(LocalActor *actor)
+{
+    return __atomic_load_n(&actor->inputQueue->pending, __ATOMIC_RELAXED);
+}
+
+size_t
+globalActor_GetQueueDepth(GlobalActor *actor)
+{
+    return actor_GetQueueDepth(actor->actor);
 }
 
-cJSON *
-localActor_SendMessageSync(LocalActor *actor, cJSON *message)
+static Actor *
+poolActor_Choose(PoolActor *pool)
 {
-    ChannelMessage *channelMessage = channelMessage_Create(message);
-    Signal *thesignal = channelMessage_GetSignal(channelMessage);
-    signal_Lock(thesignal);
+    switch (pool->dispatch) {
+        case ActorPool_RoundRobin:
+            return pool->replicas[__sync_fetch_and_add(&pool->next, 1) % pool->count];
+        case ActorPool_LeastLoaded: {
+            // Start the search somewhere new each time so that ties, such as
+            // several idle replicas, are shared out evenly
+            size_t start = __sync_fetch_and_add(&pool->next, 1);
+            Actor *best = NULL;
+            size_t bestLoad = 0;
+            for (size_t i = 0; i < pool->count; i++) {
+                Actor *replica = pool->replicas[(start + i) % pool->count];
+                size_t load = localActor_GetLoad((LocalActor *) replica->instance);
+                if (best == NULL || load < bestLoad) {
+                    best = replica;
+                    bestLoad = load;
+                    if (load == 0) {
+                        break;
+                    }
+                }
+            }
+            return best;
+        }
+        case ActorPool_WorkSharing:
+        default:
+            // Any replica's mailbox is every replica's mailbox
+            return pool->replicas[0];
+    }
+}
 
-    channelMessage = ActorMessageQueue_PushMessage(actor->inputQueue, channelMessage);
+int
+poolActor_SendMessageAsync(PoolActor *actor, void *message, Future *future)
+{
+    return actor_SendMessageAsync(poolActor_Choose(actor), message, future);
+}
+
+void *
+poolActor_SendMessageSync(PoolActor *actor, void *message)
+{
+    return actor_SendMessageSync(poolActor_Choose(actor), message);
+}
 
-    signal_Wait(thesignal, NULL);
-    signal_Unlock(thesignal);
+void
+poolActor_SetMailbox(PoolActor *actor, size_t capacity, ActorMailboxPolicy policy)
+{
+    for (size_t i = 0; i < actor->count; i++) {
+        actor_SetMailbox(actor->replicas[i], capacity, policy);
+    }
+}
 
-    cJSON *output = channelMessage_GetOutput(channelMessage);
+size_t
+poolActor_GetQueueDepth(PoolActor *actor)
+{
+    if (actor->dispatch == ActorPool_WorkSharing) {
+        return actor_GetQueueDepth(actor->replicas[0]);
+    }
 
-    return output;
+    size_t depth = 0;
+    for (size_t i = 0; i < actor->count; i++) {
+        depth += actor_GetQueueDepth(actor->replicas[i]);
+    }
+    return depth;
+}
+
+void
+poolActor_Start(PoolActor *actor)
+{
+    for (size_t i = 0; i < actor->count; i++) {
+        actor_Start(actor->replicas[i]);
+    }
 }
 
 ActorID
@@ -218,14 +573,26 @@ actor_Start(Actor *actor)
     actor->interface->start(actor->instance);
 }
 
-void
-actor_SendMessageAsync(Actor *actor, cJSON *message)
+int
+actor_SendMessageAsync(Actor *actor, void *message, Future *future)
 {
-    actor->interface->sendMessageAsync(actor->instance, message);
+    return actor->interface->sendMessageAsync(actor->instance, message, future);
 }
 
-cJSON *
-actor_SendMessageSync(Actor *actor, cJSON *message)
+void *
+actor_SendMessageSync(Actor *actor, void *message)
 {
     return actor->interface->sendMessageSync(actor->instance, message);
 }
+
+void
+actor_SetMailbox(Actor *actor, size_t capacity, ActorMailboxPolicy policy)
+{
+    actor->interface->setMailbox(actor->instance, capacity, policy);
+}
+
+size_t
+actor_GetQueueDepth(Actor *actor)
+{
+    return actor->interface->getQueueDepth(actor->instance);
+}
@@ -4,24 +4,131 @@
 #include <stddef.h>
 
 #include "signal.h"
-#include "encoding/cJSON.h"
+#include "future.h"
+#include "buffer.h"
 
 typedef size_t ActorID;
 typedef struct actor Actor;
 
+// What a send does when the actor's mailbox is full
+typedef enum {
+    ActorMailbox_Block,      // wait for the actor to make room
+    ActorMailbox_DropOldest, // enqueue anyway and discard the oldest message
+    ActorMailbox_Error       // refuse the new message
+} ActorMailboxPolicy;
+
+// How a pool of replicas shares out the messages sent to it
+typedef enum {
+    ActorPool_RoundRobin,  // each send goes to the next replica in turn
+    ActorPool_LeastLoaded, // each send goes to the replica with the fewest messages queued or in hand
+    ActorPool_WorkSharing  // replicas take messages from one shared mailbox
+} ActorPoolDispatch;
+
 typedef struct actor_implementation {
     void (*start)(void *);
-    void (*sendMessageAsync)(void *, cJSON *);
-    cJSON *(*sendMessageSync)(void *, cJSON *);
+    int (*sendMessageAsync)(void *, void *, Future *);
+    void *(*sendMessageSync)(void *, void *);
+    void (*setMailbox)(void *, size_t, ActorMailboxPolicy);
+    size_t (*getQueueDepth)(void *);
     ActorID (*getID)(void *);
 } ActorInterface;
 
-Actor *actor_CreateLocal(void *metadata, cJSON *(*callback)(void *metadata, cJSON *message));
-Actor *actor_CreateGlobal(char *name, void *metadata, cJSON *(*callback)(void *metadata, cJSON *message));
+/**
+ * Create an actor that runs `callback` on each message sent to it from this
+ * process. Messages and replies are passed by pointer and never encoded: the
+ * callback takes ownership of the message and returns a reply, which goes to
+ * a sync sender or, for an async send, is handed to `release`.
+ *
+ * @param [in] metadata Passed to every call of `callback`.
+ * @param [in] callback Handles one message and returns its reply.
+ * @param [in] release Frees a reply that nobody is waiting for, or a message that is discarded.
+ *
+ * Example:
+ * @code
+ * {
+ *     Actor *actor = actor_CreateLocal(wrapper, handler, (void (*)(void *)) value_Delete);
+ *     actor_Start(actor);
+ *     Value *reply = (Value *) actor_SendMessageSync(actor, message);
+ * }
+ * @endcode
+ */
+Actor *actor_CreateLocal(void *metadata, void *(*callback)(void *metadata, void *message), void (*release)(void *reply));
+
+/**
+ * Create an actor that is also published under `name`. Local senders go
+ * through `callback` exactly as for `actor_CreateLocal`; requests arriving
+ * over CCN are encoded and go through `encodedCallback` instead, which
+ * returns the encoded reply.
+ */
+Actor *actor_CreateGlobal(char *name, void *metadata, void *(*callback)(void *metadata, void *message),
+    void (*release)(void *reply), CBuffer *(*encodedCallback)(void *metadata, const uint8_t *message, size_t length));
+
+/**
+ * Publish an existing actor under `name`, as `actor_CreateGlobal` does for a
+ * new one. Requests arriving over CCN go through `encodedCallback`.
+ */
+Actor *actor_Publish(char *name, Actor *actor, void *metadata,
+    CBuffer *(*encodedCallback)(void *metadata, const uint8_t *message, size_t length));
+
+/**
+ * Create an actor that spreads the messages sent to it over `count` replicas
+ * made by `actor_CreateLocal`, so that a stateless handler can run on several
+ * workers at once. The pool takes over the replicas, which must not have been
+ * started or sent anything yet. Under ActorPool_WorkSharing their mailboxes
+ * are merged into one.
+ *
+ * @param [in] replicas The replicas; the array itself is copied.
+ * @param [in] count The number of replicas, at least 1.
+ * @param [in] dispatch How to choose a replica for each message.
+ *
+ * Example:
+ * @code
+ * {
+ *     Actor *replicas[4];
+ *     for (int i = 0; i < 4; i++) {
+ *         replicas[i] = actor_CreateLocal(wrappers[i], handler, (void (*)(void *)) value_Delete);
+ *     }
+ *     Actor *pool = actor_CreatePool(replicas, 4, ActorPool_LeastLoaded);
+ *     actor_Start(pool);
+ * }
+ * @endcode
+ */
+Actor *actor_CreatePool(Actor **replicas, size_t count, ActorPoolDispatch dispatch);
 
 void actor_Start(Actor *actor);
-void actor_SendMessageAsync(Actor *actor, cJSON *message);
-cJSON *actor_SendMessageSync(Actor *actor, cJSON *message);
+/**
+ * Queue `message` for the actor and return at once. The reply is stored in
+ * `future`, whose reference the actor takes over, or dropped if `future` is
+ * NULL. A message that is discarded without being handled completes its
+ * future with NULL.
+ *
+ * @return 0 if the mailbox was full and its policy refused the message, 1 otherwise.
+ */
+int actor_SendMessageAsync(Actor *actor, void *message, Future *future);
+
+/**
+ * Send `message` and wait for the reply.
+ *
+ * @return The reply, or NULL if the message was refused or discarded because
+ * the mailbox was full.
+ */
+void *actor_SendMessageSync(Actor *actor, void *message);
+
+/**
+ * Bound the actor's mailbox to `capacity` messages, or 0 for no bound, and
+ * choose what a send does when it is full. Call before the actor is shared.
+ * Actors start unbounded with ActorMailbox_Block.
+ *
+ * Messages discarded under ActorMailbox_DropOldest or refused under
+ * ActorMailbox_Error are freed with the actor's `release` function.
+ */
+void actor_SetMailbox(Actor *actor, size_t capacity, ActorMailboxPolicy policy);
+
+/**
+ * Return the number of messages waiting in the actor's mailbox, or in all
+ * the mailboxes of a pool.
+ */
+size_t actor_GetQueueDepth(Actor *actor);
 ActorID actor_GetID(const Actor *actor);
 
 #endif // libcool_internal_actor_
@@ -18,14 +18,14 @@ static CBuffer *
 _make_space(CBuffer *buffer, size_t length)
 {
     if (buffer->offset + length > buffer->capacity) {
-        buffer = realloc(buffer, sizeof(CBuffer) * ((buffer->offset + sizeof(int)) * 2));
-        buffer->capacity = ((buffer->offset + length) * 2);
+        buffer->capacity = (buffer->offset + length) * 2;
+        buffer->bytes = realloc(buffer->bytes, buffer->capacity);
     }
     return buffer;
 }
 
 static CBuffer *
-_add_data(CBuffer *buffer, size_t length, uint8_t *bytes)
+_add_data(CBuffer *buffer, size_t length, const void *bytes)
 {
     memcpy(buffer->bytes + buffer->offset, bytes, length);
     buffer->offset += length;
@@ -54,11 +54,11 @@ CBuffer *
 cbuffer_AppendInt(CBuffer *buffer, int x)
 {
     size_t length = sizeof(int);
-    return _add_data(_make_space(buffer, length), length, (uint8_t *) &x);
+    return _add_data(_make_space(buffer, length), length, &x);
 }
 
 CBuffer *
-cbuffer_AppendBytes(CBuffer *buffer, size_t length, uint8_t bytes[length])
+cbuffer_AppendBytes(CBuffer *buffer, size_t length, const uint8_t bytes[length])
 {
     return _add_data(_make_space(buffer, length), length, bytes);
 }
@@ -67,5 +67,42 @@ CBuffer *
 cbuffer_AppendString(CBuffer *buffer, char *string)
 {
     size_t length = strlen(string);
-    return _add_data(_make_space(buffer, length), length, (uint8_t *) string);
+    return _add_data(_make_space(buffer, length), length, string);
+}
+
+CBuffer *
+cbuffer_AppendByte(CBuffer *buffer, uint8_t byte)
+{
+    return _add_data(_make_space(buffer, 1), 1, &byte);
+}
+
+CBuffer *
+cbuffer_AppendVarint(CBuffer *buffer, uint64_t x)
+{
+    uint8_t bytes[10];
+    size_t length = 0;
+    do {
+        bytes[length] = (x & 0x7F) | (x > 0x7F ? 0x80 : 0);
+        x >>= 7;
+        length++;
+    } while (x > 0);
+    return _add_data(_make_space(buffer, length), length, bytes);
+}
+
+void
+cbuffer_Clear(CBuffer *buffer)
+{
+    buffer->offset = 0;
+}
+
+uint8_t *
+cbuffer_GetBytes(CBuffer *buffer)
+{
+    return buffer->bytes;
+}
+
+size_t
+cbuffer_GetLength(CBuffer *buffer)
+{
+    return buffer->offset;
 }
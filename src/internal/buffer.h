@@ -1,6 +1,9 @@
 #ifndef libcool_internal_buffer_
 #define libcool_internal_buffer_
 
+#include <stddef.h>
+#include <stdint.h>
+
 struct c_buffer;
 typedef struct c_buffer CBuffer;
 
@@ -8,7 +11,22 @@ CBuffer *cbuffer_Create();
 void cbuffer_Delete(CBuffer **bufferP);
 
 CBuffer *cbuffer_AppendInt(CBuffer *buffer, int x);
-CBuffer *cbuffer_AppendBytes(CBuffer *buffer, size_t length, uint8_t bytes[length]);
+CBuffer *cbuffer_AppendBytes(CBuffer *buffer, size_t length, const uint8_t bytes[length]);
 CBuffer *cbuffer_AppendString(CBuffer *buffer, char *string);
+CBuffer *cbuffer_AppendByte(CBuffer *buffer, uint8_t byte);
+
+/**
+ * Append `x` as an unsigned LEB128 varint: seven bits per byte, least
+ * significant first, with the top bit set on every byte but the last.
+ */
+CBuffer *cbuffer_AppendVarint(CBuffer *buffer, uint64_t x);
+
+/**
+ * Empty the buffer, keeping its storage for reuse.
+ */
+void cbuffer_Clear(CBuffer *buffer);
+
+uint8_t *cbuffer_GetBytes(CBuffer *buffer);
+size_t cbuffer_GetLength(CBuffer *buffer);
 
 #endif
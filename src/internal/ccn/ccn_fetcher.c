@@ -33,17 +33,16 @@ ccnFetcher_Create()
     return consumer;
 }
 
-cJSON *
-ccnFetcher_Fetch(CCNFetcher *fetcher, char *nameString, cJSON *message)
+CBuffer *
+ccnFetcher_Fetch(CCNFetcher *fetcher, char *nameString, CBuffer *message)
 {
     CCNxName *name = ccnxName_CreateFromCString(nameString);
     if (name != NULL) {
         PARCBuffer *buffer = NULL;
         if (message != NULL) {
-            char *payload = cJSON_Print(message);
-            size_t payloadSize = strlen(payload);
-            buffer = parcBuffer_Allocate(payloadSize + 1);
-            parcBuffer_Flip(parcBuffer_PutArray(buffer, payloadSize, payload));
+            size_t payloadSize = cbuffer_GetLength(message);
+            buffer = parcBuffer_Allocate(payloadSize);
+            parcBuffer_Flip(parcBuffer_PutArray(buffer, payloadSize, cbuffer_GetBytes(message)));
         }
 
         CCNxInterest *interest = ccnxInterest_CreateSimple(name);
@@ -53,7 +52,7 @@ ccnFetcher_Fetch(CCNFetcher *fetcher, char *nameString, cJSON *message)
         }
 
         CCNxMetaMessage *message = ccnxMetaMessage_CreateFromInterest(interest);
-        cJSON *response = cJSON_Parse("{}");
+        CBuffer *response = NULL;
 
         if (ccnxPortal_Send(fetcher->portal, message, CCNxStackTimeout_Never)) {
             while (ccnxPortal_IsError(fetcher->portal) == false) {
@@ -64,8 +63,9 @@ ccnFetcher_Fetch(CCNFetcher *fetcher, char *nameString, cJSON *message)
 
                         PARCBuffer *payload = ccnxContentObject_GetPayload(contentObject);
 
-                        char *bufferString = parcBuffer_ToString(payload);
-                        response = cJSON_Parse(bufferString);
+                        size_t payloadSize = parcBuffer_Remaining(payload);
+                        response = cbuffer_Create();
+                        cbuffer_AppendBytes(response, payloadSize, parcBuffer_Overlay(payload, payloadSize));
                         parcBuffer_Release(&payload);
 
                         break;
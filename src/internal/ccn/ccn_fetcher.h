@@ -1,13 +1,19 @@
 #ifndef libcool_internal_ccn_fetcher_
 #define libcool_internal_ccn_fetcher_
 
-#include <internal/encoding/cJSON.h>
+#include <internal/buffer.h>
 
 struct ccn_fetcher;
 typedef struct ccn_fetcher CCNFetcher;
 
 CCNFetcher *ccnFetcher_Create();
 
-cJSON *ccnFetcher_Fetch(CCNFetcher *fetcher, char *nameString, cJSON *message);
+/**
+ * Send `message` in an interest for `nameString` and wait for the content
+ * that answers it.
+ *
+ * @return The content's payload, or NULL if the name is invalid or no content arrived.
+ */
+CBuffer *ccnFetcher_Fetch(CCNFetcher *fetcher, char *nameString, CBuffer *message);
 
 #endif // libcool_internal_ccn_fetcher_
@@ -24,12 +24,12 @@ struct ccn_producer {
     // TODO: add handle to the repo here
 
     void *callbackMetadata;
-    cJSON *(*callback)();
+    CBuffer *(*callback)(void *, const uint8_t *, size_t);
 };
 
 // TOOD: we should really return an Optional here
 CCNProducer *
-ccnProducer_Create(char *prefix, void *callbackMetadata, cJSON *(*callback)(void *, cJSON *))
+ccnProducer_Create(char *prefix, void *callbackMetadata, CBuffer *(*callback)(void *, const uint8_t *, size_t))
 {
     parcSecurity_Init();
 
@@ -52,7 +52,7 @@ ccnProducer_Create(char *prefix, void *callbackMetadata, cJSON *(*callback)(void
     }
 }
 
-cJSON *
+CBuffer *
 producerPortal_Get(CCNProducer *producer, CCNxName **name)
 {
     CCNxMetaMessage *request = ccnxPortal_Receive(producer->portal, CCNxStackTimeout_Never);
@@ -66,8 +66,9 @@ producerPortal_Get(CCNProducer *producer, CCNxName **name)
     // Save the name so that the entity can act on it
     *name = ccnxName_CreateFromCString(ccnxName_ToString(ccnxInterest_GetName(interest)));
     PARCBuffer *buffer = parcBuffer_Acquire(ccnxInterest_GetPayload(interest));
-    char *bufferString = parcBuffer_ToString(buffer);
-    cJSON *message = cJSON_Parse(bufferString);
+    size_t length = parcBuffer_Remaining(buffer);
+    CBuffer *message = cbuffer_Create();
+    cbuffer_AppendBytes(message, length, parcBuffer_Overlay(buffer, length));
 
     parcBuffer_Release(&buffer);
     ccnxMetaMessage_Release(&request);
@@ -76,10 +77,11 @@ producerPortal_Get(CCNProducer *producer, CCNxName **name)
 }
 
 void
-producerPortal_Put(CCNProducer *producer, CCNxName *name, cJSON *buffer) // interest is the response
+producerPortal_Put(CCNProducer *producer, CCNxName *name, CBuffer *buffer) // interest is the response
 {
-    char *bufferString = cJSON_Print(buffer);
-    PARCBuffer *responsePayload = parcBuffer_WrapCString(bufferString);
+    size_t length = cbuffer_GetLength(buffer);
+    PARCBuffer *responsePayload = parcBuffer_Allocate(length);
+    parcBuffer_Flip(parcBuffer_PutArray(responsePayload, length, cbuffer_GetBytes(buffer)));
 
     CCNxContentObject *response = ccnxContentObject_CreateWithNameAndPayload(name, responsePayload);
     CCNxMetaMessage *message = ccnxMetaMessage_CreateFromContentObject(response);
@@ -94,13 +96,13 @@ ccnProducer_Run(CCNProducer *producer)
 {
     for (;;) {
         CCNxName *name = NULL;
-        cJSON *message = producerPortal_Get(producer, &name);
+        CBuffer *message = producerPortal_Get(producer, &name);
         if (message != NULL) {
-            cJSON *response = producer->callback(producer->callbackMetadata, message);
+            CBuffer *response = producer->callback(producer->callbackMetadata,
+                cbuffer_GetBytes(message), cbuffer_GetLength(message));
             producerPortal_Put(producer, name, response);
-        } else {
-            cJSON *emptyResponse = cJSON_CreateString("Invalid message");
-            producerPortal_Put(producer, name, emptyResponse);
+            cbuffer_Delete(&response);
+            cbuffer_Delete(&message);
         }
     }
 }
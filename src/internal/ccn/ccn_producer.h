@@ -2,13 +2,17 @@
 #define libcool_internal_ccn_producer_
 
 #include <stdbool.h>
-#include <internal/encoding/cJSON.h>
 #include <internal/buffer.h>
 
 struct ccn_producer;
 typedef struct ccn_producer CCNProducer;
 
-CCNProducer *ccnProducer_Create(char *prefix, void *callbackMetadata, cJSON *(*callback)(void *, cJSON *));
+/**
+ * Listen for interests under `prefix`. `callback` gets each interest's
+ * payload and returns the payload of the content sent back.
+ */
+CCNProducer *ccnProducer_Create(char *prefix, void *callbackMetadata,
+    CBuffer *(*callback)(void *metadata, const uint8_t *message, size_t length));
 void ccnProducer_Run(CCNProducer *producer);
 bool ccnProducer_Publish(CCNProducer *producer, CBuffer *data);
 
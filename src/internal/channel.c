@@ -1,54 +1,117 @@
 #include <stdlib.h>
+#include <sched.h>
 #include <pthread.h>
 
 #include "channel.h"
+#include "parker.h"
+#include "slab.h"
 
 struct channel_message;
 
 struct channel_message {
-    cJSON *input;
-    cJSON *output;
+    void *input;
+    void *output;
+    int done;
+
+    // Thread to wake when the output is set, or NULL if nobody is waiting
+    Parker *waiter;
+
+    // Where an async reply goes, or NULL to drop it
+    Future *future;
 
     struct channel_message *next;
-    Signal *signal;
 };
 
+// A parker waiting for space, linked on the waiting fiber's own stack
+typedef struct channel_space_waiter {
+    Parker *parker;
+    struct channel_space_waiter *next;
+} ChannelSpaceWaiter;
+
+// Intrusive multi-producer single-consumer queue (Vyukov). Producers swap
+// themselves into `head` with one atomic exchange and then link the previous
+// head to the new node; the single consumer walks from `tail`. A stub node
+// keeps the list non-empty so producers and the consumer never touch the
+// same pointer. The consumer parks only when it finds the queue empty.
+//
+// A bounded channel reserves a slot in `size` before pushing. Producers that
+// find it full wait on `spaceCond`, or park on a parker listed in `waiters`,
+// which consumers only signal when someone is blocked, so the unbounded and
+// not-full paths never take a lock.
 struct channel {
-    struct channel_message *head;
-    struct channel_message *tail;
+    ChannelMessage *head;
+    ChannelMessage *tail;
+    ChannelMessage stub;
     size_t size;
-    Signal *signal;
+    size_t capacity; // 0 for unbounded
+    Parker parker;
 
-    void (*delete)(cJSON **element);
+    // Held while removing from `tail`, so a producer can drop the oldest
+    // message without racing the consumer
+    int consuming;
+
+    int blocked; // producers waiting for space
+    pthread_mutex_t spaceMutex;
+    pthread_cond_t spaceCond;
+    ChannelSpaceWaiter *waiters; // guarded by `spaceMutex`
+
+    void (*delete)(void **element);
 };
 
 void
 channelMessage_Destroy(ChannelMessage **nodeP)
 {
     ChannelMessage *result = (ChannelMessage *) *nodeP;
-    free(result);
+    slab_Free(result, sizeof(ChannelMessage));
     *nodeP = NULL;
 }
 
 ChannelMessage *
-channelMessage_Create(cJSON *element)
+channelMessage_Create(void *element)
 {
-    ChannelMessage *result = (ChannelMessage *) malloc(sizeof(ChannelMessage));
+    ChannelMessage *result = (ChannelMessage *) slab_Allocate(sizeof(ChannelMessage));
     result->input = element;
     result->output = NULL;
+    result->done = 0;
+    result->waiter = NULL;
+    result->future = NULL;
     result->next = NULL;
-    result->signal = signal_Create(result);
+    return result;
+}
+
+ChannelMessage *
+channelMessage_CreateFuture(void *element, Future *future)
+{
+    ChannelMessage *result = channelMessage_Create(element);
+    result->future = future;
+    return result;
+}
+
+ChannelMessage *
+channelMessage_CreateSync(void *element)
+{
+    ChannelMessage *result = channelMessage_Create(element);
+    // Every thread that waits for a reply parks on its own parker, so a
+    // message only has to remember whom to wake
+    result->waiter = parker_GetThreadParker();
     return result;
 }
 
 Channel *
-channel_Create(void (*delete)(cJSON **element))
+channel_Create(void (*delete)(void **element))
 {
     Channel *result = (Channel *) malloc(sizeof(Channel));
     result->size = 0;
-    result->head = result->tail = NULL;
+    result->capacity = 0;
+    result->stub.next = NULL;
+    result->head = result->tail = &result->stub;
     result->delete = delete;
-    result->signal = signal_Create(result);
+    parker_Init(&result->parker);
+    result->consuming = 0;
+    result->blocked = 0;
+    result->waiters = NULL;
+    pthread_mutex_init(&result->spaceMutex, NULL);
+    pthread_cond_init(&result->spaceCond, NULL);
 
     return result;
 }
@@ -58,65 +121,267 @@ channel_Destroy(Channel **channelP)
 {
     Channel *channel = (Channel *) *channelP;
 
-    ChannelMessage *current = channel->head;
-    for (size_t i = 0; i < channel->size; i++) {
-        channel->delete(&(current->input));
-        channel->delete(&(current->output));
-        current = current->next;
+    // Everything from `tail` on is still queued, apart from the stub
+    ChannelMessage *current = channel->tail;
+    while (current != NULL) {
+        ChannelMessage *next = current->next;
+        if (current != &channel->stub) {
+            if (channel->delete != NULL) {
+                channel->delete(&(current->input));
+                channel->delete(&(current->output));
+            }
+            channelMessage_Destroy(&current);
+        }
+        current = next;
     }
 
-    signal_Destroy(&channel->signal);
+    parker_Destroy(&channel->parker);
+    pthread_mutex_destroy(&channel->spaceMutex);
+    pthread_cond_destroy(&channel->spaceCond);
 
     free(channel);
     *channelP = NULL;
 }
 
+static void
+_channel_Push(Channel *channel, ChannelMessage *node)
+{
+    node->next = NULL;
+    ChannelMessage *previous = __atomic_exchange_n(&channel->head, node, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&previous->next, node, __ATOMIC_RELEASE);
+}
+
 ChannelMessage *
 channel_Enqueue(Channel *channel, ChannelMessage *newNode)
 {
-    signal_Lock(channel->signal);
+    // Count the message before it is reachable, so the size never
+    // understates what the consumer can see
+    __atomic_add_fetch(&channel->size, 1, __ATOMIC_SEQ_CST);
+    _channel_Push(channel, newNode);
+    parker_Unpark(&channel->parker);
 
-    if (channel->head == NULL || channel->tail == NULL) {
-        channel->head = channel->tail = newNode;
-    } else {
-        channel->tail->next = newNode;
-        channel->tail = newNode;
-    }
+    return newNode;
+}
+
+int
+channel_IsEmpty(Channel *channel)
+{
+    return channel_GetSize(channel) == 0;
+}
+
+void
+channel_SetCapacity(Channel *channel, size_t capacity)
+{
+    channel->capacity = capacity;
+}
 
-    channel->size++;
+size_t
+channel_GetCapacity(Channel *channel)
+{
+    return channel->capacity;
+}
+
+ChannelMessage *
+channel_TryEnqueue(Channel *channel, ChannelMessage *newNode)
+{
+    size_t size = __atomic_load_n(&channel->size, __ATOMIC_SEQ_CST);
+    do {
+        if (channel->capacity > 0 && size >= channel->capacity) {
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&channel->size, &size, size + 1, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
 
-    signal_Notify(channel->signal);
-    signal_Unlock(channel->signal);
+    _channel_Push(channel, newNode);
+    parker_Unpark(&channel->parker);
 
     return newNode;
 }
 
-int
-channel_IsEmpty(Channel *channel)
+void
+channel_WaitForSpace(Channel *channel)
+{
+    pthread_mutex_lock(&channel->spaceMutex);
+    __atomic_add_fetch(&channel->blocked, 1, __ATOMIC_SEQ_CST);
+    while (channel_GetSize(channel) >= channel->capacity) {
+        pthread_cond_wait(&channel->spaceCond, &channel->spaceMutex);
+    }
+    __atomic_sub_fetch(&channel->blocked, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&channel->spaceMutex);
+}
+
+void
+channel_ParkForSpace(Channel *channel)
+{
+    ChannelSpaceWaiter waiter = { parker_GetThreadParker(), NULL };
+
+    pthread_mutex_lock(&channel->spaceMutex);
+    __atomic_add_fetch(&channel->blocked, 1, __ATOMIC_SEQ_CST);
+    if (channel_GetSize(channel) >= channel->capacity) {
+        waiter.next = channel->waiters;
+        channel->waiters = &waiter;
+        pthread_mutex_unlock(&channel->spaceMutex);
+
+        parker_Park(waiter.parker);
+
+        // A permit left over from an earlier wait can return early, while
+        // the waiter is still listed
+        pthread_mutex_lock(&channel->spaceMutex);
+        for (ChannelSpaceWaiter **link = &channel->waiters; *link != NULL; link = &(*link)->next) {
+            if (*link == &waiter) {
+                *link = waiter.next;
+                break;
+            }
+        }
+    }
+    __atomic_sub_fetch(&channel->blocked, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&channel->spaceMutex);
+}
+
+static void
+_channel_LockConsumer(Channel *channel)
+{
+    while (__atomic_exchange_n(&channel->consuming, 1, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+}
+
+static void
+_channel_UnlockConsumer(Channel *channel)
+{
+    __atomic_store_n(&channel->consuming, 0, __ATOMIC_RELEASE);
+}
+
+static ChannelMessage *_channel_Remove(Channel *channel);
+
+ChannelMessage *
+channel_EnqueueDropOldest(Channel *channel, ChannelMessage *newNode)
+{
+    size_t size = __atomic_add_fetch(&channel->size, 1, __ATOMIC_SEQ_CST);
+    _channel_Push(channel, newNode);
+    parker_Unpark(&channel->parker);
+
+    ChannelMessage *dropped = NULL;
+    if (channel->capacity > 0 && size > channel->capacity) {
+        _channel_LockConsumer(channel);
+        if (channel_GetSize(channel) > channel->capacity) {
+            dropped = _channel_Remove(channel);
+        }
+        _channel_UnlockConsumer(channel);
+    }
+    return dropped;
+}
+
+static ChannelMessage *_channel_Unlink(Channel *channel);
+
+// Wake producers blocked in channel_WaitForSpace or channel_ParkForSpace,
+// if there are any
+static void
+_channel_SignalSpace(Channel *channel)
 {
-    return channel->size == 0;
+    if (__atomic_load_n(&channel->blocked, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&channel->spaceMutex);
+        pthread_cond_broadcast(&channel->spaceCond);
+        for (ChannelSpaceWaiter *waiter = channel->waiters; waiter != NULL; waiter = waiter->next) {
+            parker_Unpark(waiter->parker);
+        }
+        channel->waiters = NULL;
+        pthread_mutex_unlock(&channel->spaceMutex);
+    }
 }
 
 ChannelMessage *
-channel_Dequeue(Channel *channel)
+channel_TryDequeue(Channel *channel)
+{
+    _channel_LockConsumer(channel);
+    ChannelMessage *target = _channel_Remove(channel);
+    _channel_UnlockConsumer(channel);
+
+    if (target != NULL) {
+        _channel_SignalSpace(channel);
+    }
+    return target;
+}
+
+size_t
+channel_TryDequeueBatch(Channel *channel, ChannelMessage **messages, size_t max)
 {
-    signal_Lock(channel->signal);
+    size_t count = 0;
+
+    _channel_LockConsumer(channel);
+    while (count < max && (messages[count] = _channel_Unlink(channel)) != NULL) {
+        count++;
+    }
+    if (count > 0) {
+        __atomic_sub_fetch(&channel->size, count, __ATOMIC_SEQ_CST);
+    }
+    _channel_UnlockConsumer(channel);
 
-    while (channel_IsEmpty(channel)) {
-        signal_Wait(channel->signal, NULL);
+    if (count > 0) {
+        _channel_SignalSpace(channel);
     }
-    // signal_Wait(channel->signal, (int (*)(void *)) channel_IsEmpty);
+    return count;
+}
+
+static ChannelMessage *
+_channel_Remove(Channel *channel)
+{
+    ChannelMessage *target = _channel_Unlink(channel);
+    if (target != NULL) {
+        __atomic_sub_fetch(&channel->size, 1, __ATOMIC_SEQ_CST);
+    }
+    return target;
+}
+
+// Take the oldest node off the list without updating `size`
+static ChannelMessage *
+_channel_Unlink(Channel *channel)
+{
+    ChannelMessage *tail = channel->tail;
+    ChannelMessage *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
 
-    ChannelMessage *target = channel->head;
+    if (tail == &channel->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        channel->tail = next;
+        tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
 
-    channel->head = channel->head->next;
-    channel->size--;
+    if (next == NULL) {
+        // `tail` looks like the last node. Either it is, and the stub goes
+        // back in behind it, or a producer has swapped in a newer head and
+        // has yet to link it. Both leave `tail->next` set within a few
+        // instructions of the producer running.
+        if (tail == __atomic_load_n(&channel->head, __ATOMIC_ACQUIRE)) {
+            _channel_Push(channel, &channel->stub);
+        }
+        while ((next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE)) == NULL) {
+            sched_yield();
+        }
+    }
 
-    signal_Unlock(channel->signal);
+    channel->tail = next;
+    return tail;
+}
 
+ChannelMessage *
+channel_Dequeue(Channel *channel)
+{
+    ChannelMessage *target;
+    while ((target = channel_TryDequeue(channel)) == NULL) {
+        parker_Park(&channel->parker);
+    }
     return target;
 }
 
+size_t
+channel_GetSize(Channel *channel)
+{
+    return __atomic_load_n(&channel->size, __ATOMIC_SEQ_CST);
+}
+
 // void *
 // channel_GetAtIndex(Channel *channel, size_t index)
 // {
@@ -179,25 +444,54 @@ channel_Dequeue(Channel *channel)
 //     }
 // }
 
-Signal *
-channelMessage_GetSignal(ChannelMessage *message)
+void
+channelMessage_Complete(ChannelMessage *message, void *data)
 {
-    return message->signal;
+    // The waiter may free the message as soon as it sees `done`, so read
+    // everything we need from it first
+    Parker *waiter = message->waiter;
+    message->output = data;
+    __atomic_store_n(&message->done, 1, __ATOMIC_RELEASE);
+    parker_Unpark(waiter);
 }
 
-void
-channelMessage_SetOutput(ChannelMessage *message, cJSON *data)
+int
+channelMessage_HasWaiter(ChannelMessage *message)
 {
-    message->output = data;
+    return message->waiter != NULL;
+}
+
+Future *
+channelMessage_GetFuture(ChannelMessage *message)
+{
+    return message->future;
+}
+
+int
+channelMessage_IsDone(ChannelMessage *message)
+{
+    return __atomic_load_n(&message->done, __ATOMIC_ACQUIRE);
+}
+
+void *
+channelMessage_Wait(ChannelMessage *message)
+{
+    while (!channelMessage_IsDone(message)) {
+        parker_Park(message->waiter);
+    }
+
+    void *output = message->output;
+    channelMessage_Destroy(&message);
+    return output;
 }
 
-cJSON *
+void *
 channelMessage_GetOutput(ChannelMessage *message)
 {
     return message->output;
 }
 
-cJSON *
+void *
 channelMessage_GetPayload(ChannelMessage *message)
 {
     return message->input;
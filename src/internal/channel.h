@@ -1,8 +1,9 @@
 #ifndef libcool_internal_channel_
 #define libcool_internal_channel_
 
-#include "signal.h"
-#include "encoding/cJSON.h"
+#include <stddef.h>
+
+#include "future.h"
 
 typedef struct channel Channel;
 typedef struct channel_message ChannelMessage;
@@ -12,6 +13,9 @@ typedef struct channel_message ChannelMessage;
  * that each element in a `Channel` will be of the same type.
  *
  * @param [in] element A pointer to an element from which to create a node.
+ * @param [in] delete Frees the payload and reply of each message still queued
+ *     when the channel is destroyed, or NULL to leave them alone. The messages
+ *     themselves are always freed.
  *
  * Example:
  * @code
@@ -20,19 +24,137 @@ typedef struct channel_message ChannelMessage;
  * }
  * @endcode
  */
-Channel *channel_Create();
+Channel *channel_Create(void (*delete)(void **element));
 void channel_Destroy(Channel **channelP);
 
-ChannelMessage *channelMessage_Create(cJSON *element);
+ChannelMessage *channelMessage_Create(void *element);
+
+/**
+ * Create a message whose sender will wait for the reply on the calling
+ * thread. Messages come from the calling thread's slab cache, so sending
+ * allocates no locks or condition variables.
+ *
+ * @param [in] element The payload, handed to the channel's consumer as is.
+ *
+ * Example:
+ * @code
+ * {
+ *     ChannelMessage *message = channelMessage_CreateSync(payload);
+ *     channel_Enqueue(channel, message);
+ *     Value *reply = (Value *) channelMessage_Wait(message);
+ * }
+ * @endcode
+ */
+ChannelMessage *channelMessage_CreateSync(void *element);
+
+/**
+ * Create a message whose reply is delivered to `future` rather than to a
+ * waiting sender. The message holds the caller's reference to the future.
+ */
+ChannelMessage *channelMessage_CreateFuture(void *element, Future *future);
+void channelMessage_Destroy(ChannelMessage **messageP);
 ChannelMessage *channel_Enqueue(Channel *channel, ChannelMessage *element);
 ChannelMessage *channel_Dequeue(Channel *channel);
 
+/**
+ * Remove the oldest message in the channel without waiting. Any number of
+ * threads may enqueue concurrently; dequeues are serialized.
+ *
+ * @return The message, or NULL if the channel is empty.
+ */
+ChannelMessage *channel_TryDequeue(Channel *channel);
+
+/**
+ * Remove up to `max` of the oldest messages in one go, taking the consumer
+ * side of the channel once rather than once per message.
+ *
+ * @param [out] messages Filled with the messages, oldest first.
+ * @param [in] max The capacity of `messages`.
+ *
+ * @return The number of messages removed, 0 if the channel is empty.
+ *
+ * Example:
+ * @code
+ * {
+ *     ChannelMessage *batch[64];
+ *     size_t count = channel_TryDequeueBatch(channel, batch, 64);
+ *     for (size_t i = 0; i < count; i++) {
+ *         ...
+ *     }
+ * }
+ * @endcode
+ */
+size_t channel_TryDequeueBatch(Channel *channel, ChannelMessage **messages, size_t max);
+size_t channel_GetSize(Channel *channel);
+
+/**
+ * Limit the channel to `capacity` messages, or 0 for no limit. The limit
+ * applies to `channel_TryEnqueue` and `channel_EnqueueDropOldest`;
+ * `channel_Enqueue` ignores it. Set it before the channel is shared.
+ */
+void channel_SetCapacity(Channel *channel, size_t capacity);
+size_t channel_GetCapacity(Channel *channel);
+
+/**
+ * Enqueue `message` if the channel has room for it.
+ *
+ * @return The message, or NULL if the channel is full and it was not enqueued.
+ *
+ * Example:
+ * @code
+ * {
+ *     // Block until there is room
+ *     while (channel_TryEnqueue(channel, message) == NULL) {
+ *         channel_WaitForSpace(channel);
+ *     }
+ * }
+ * @endcode
+ */
+ChannelMessage *channel_TryEnqueue(Channel *channel, ChannelMessage *message);
+
+/**
+ * Wait until the channel is below its capacity. Another producer may take
+ * the free slot first, so retry the enqueue afterwards.
+ */
+void channel_WaitForSpace(Channel *channel);
+
+/**
+ * Like `channel_WaitForSpace`, but park on the calling thread's parker
+ * rather than block on a condition variable. On a scheduler worker only the
+ * current fiber waits and the worker carries on with other tasks.
+ */
+void channel_ParkForSpace(Channel *channel);
+
+/**
+ * Enqueue `message` unconditionally and, if that takes the channel over its
+ * capacity, remove the oldest message to make room.
+ *
+ * @return The removed message, for the caller to dispose of, or NULL.
+ */
+ChannelMessage *channel_EnqueueDropOldest(Channel *channel, ChannelMessage *message);
+
 // void *channel_GetAtIndex(Channel *channel, size_t index);
 // void *channel_RemoveAtIndex(Channel *channel, void *element, size_t index);
 
-Signal *channelMessage_GetSignal(ChannelMessage *message);
-void channelMessage_SetOutput(ChannelMessage *message, cJSON *data);
-cJSON *channelMessage_GetOutput(ChannelMessage *message);
-cJSON *channelMessage_GetPayload(ChannelMessage *message);
+/**
+ * Hand the reply `data` to the sender waiting on `message` and wake it. The
+ * sender owns the message from then on, so it must not be used after this
+ * call. Messages without a waiter are simply destroyed by their consumer.
+ */
+void channelMessage_Complete(ChannelMessage *message, void *data);
+int channelMessage_HasWaiter(ChannelMessage *message);
+Future *channelMessage_GetFuture(ChannelMessage *message);
+
+/**
+ * Block the sender of a message made by `channelMessage_CreateSync` until it
+ * is completed, then free the message.
+ *
+ * @return The reply, owned by the caller.
+ */
+void *channelMessage_Wait(ChannelMessage *message);
+
+void *channelMessage_GetOutput(ChannelMessage *message);
+int channelMessage_IsDone(ChannelMessage *message);
+void *channelMessage_GetPayload(ChannelMessage *message);
 
 #endif // libcool_internal_channel_
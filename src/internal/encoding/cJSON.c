@@ -32,6 +32,7 @@
 #include <limits.h>
 #include <ctype.h>
 #include "cJSON.h"
+#include "json_scan.h"
 
 static const char *ep;
 
@@ -175,6 +176,13 @@ static char *print_number(cJSON *item,printbuffer *p)
 	return str;
 }
 
+/* Are there four hex digits at str? Stops at the terminator, so escapes never step past it. */
+static int is_hex4(const char *str)
+{
+	int i;for (i=0;i<4;i++) if (!isxdigit((unsigned char)str[i])) return 0;
+	return 1;
+}
+
 static unsigned parse_hex4(const char *str)
 {
 	unsigned h=0;
@@ -195,7 +203,17 @@ static const char *parse_string(cJSON *item,const char *str)
 	const char *ptr=str+1;char *ptr2;char *out;int len=0;unsigned uc,uc2;
 	if (*str!='\"') {ep=str;return 0;}	/* not a string! */
 
-	while (*ptr!='\"' && *ptr && ++len) if (*ptr++ == '\\') ptr++;	/* Skip escaped quotes. */
+	for (;;)	/* Skip escaped quotes, jumping over whole runs of plain characters at a time. */
+	{
+		const char *run=jsonScan_FindSpecial(ptr);len+=run-ptr;ptr=run;
+		if (*ptr=='\"' || !*ptr) break;
+		len++;
+		if (*ptr++ == '\\')
+		{
+			if (!*ptr) {ep=ptr;return 0;}	/* a backslash right before the terminator escapes nothing. */
+			ptr++;
+		}
+	}
 
 	out=(char*)cJSON_malloc(len+1);	/* This is how long we need for the string, roughly. */
 	if (!out) return 0;
@@ -203,6 +221,8 @@ static const char *parse_string(cJSON *item,const char *str)
 	ptr=str+1;ptr2=out;
 	while (*ptr!='\"' && *ptr)
 	{
+		const char *run=jsonScan_FindSpecial(ptr);
+		if (run!=ptr) {memcpy(ptr2,ptr,run-ptr);ptr2+=run-ptr;ptr=run;continue;}	/* Copy a run of plain characters. */
 		if (*ptr!='\\') *ptr2++=*ptr++;
 		else
 		{
@@ -215,6 +235,7 @@ static const char *parse_string(cJSON *item,const char *str)
 				case 'r': *ptr2++='\r';	break;
 				case 't': *ptr2++='\t';	break;
 				case 'u':	 /* transcode utf16 to utf8. */
+					if (!is_hex4(ptr+1)) {cJSON_free(out);ep=ptr;return 0;}	/* truncated escape. */
 					uc=parse_hex4(ptr+1);ptr+=4;	/* get the unicode char. */
 
 					if ((uc>=0xDC00 && uc<=0xDFFF) || uc==0)	break;	/* check for invalid.	*/
@@ -222,6 +243,7 @@ static const char *parse_string(cJSON *item,const char *str)
 					if (uc>=0xD800 && uc<=0xDBFF)	/* UTF16 surrogate pairs.	*/
 					{
 						if (ptr[1]!='\\' || ptr[2]!='u')	break;	/* missing second-half of surrogate.	*/
+						if (!is_hex4(ptr+3)) {cJSON_free(out);ep=ptr;return 0;}	/* truncated escape. */
 						uc2=parse_hex4(ptr+3);ptr+=6;
 						if (uc2<0xDC00 || uc2>0xDFFF)		break;	/* invalid second-half of surrogate.	*/
 						uc=0x10000 + (((uc&0x3FF)<<10) | (uc2&0x3FF));
@@ -318,7 +340,7 @@ static const char *parse_object(cJSON *item,const char *value);
 static char *print_object(cJSON *item,int depth,int fmt,printbuffer *p);
 
 /* Utility to jump whitespace and cr/lf */
-static const char *skip(const char *in) {while (in && *in && (unsigned char)*in<=32) in++; return in;}
+static const char *skip(const char *in) {return in?jsonScan_SkipSpace(in):in;}
 
 /* Parse an object - create a new root, and populate. */
 cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int require_null_terminated)
@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "json_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JSON_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef const char *(*JSONScanner)(const char *text);
+
+static const char *
+_jsonScan_SkipSpaceScalar(const char *text)
+{
+    while (*text && (unsigned char) *text <= 32) {
+        text++;
+    }
+    return text;
+}
+
+static const char *
+_jsonScan_FindSpecialScalar(const char *text)
+{
+    while (*text != '"' && *text != '\\' && (unsigned char) *text >= 0x20) {
+        text++;
+    }
+    return text;
+}
+
+#ifdef JSON_SCAN_X86
+
+// The vector scans load aligned blocks, which may extend past the end of
+// the string but never into the next page. Address sanitizer would flag
+// those bytes, so it is kept out of these functions.
+#define JSON_SCAN_VECTOR(isa) __attribute__((target(isa), no_sanitize_address, noinline))
+
+// Bytes in [1, 32] are the ones that are not stops: b - 1 wraps 0 round
+// to 255, so the test is min(b - 1, 31) == b - 1
+JSON_SCAN_VECTOR("sse2") static const char *
+_jsonScan_SkipSpaceSSE2(const char *text)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i limit = _mm_set1_epi8(31);
+    uintptr_t offset = (uintptr_t) text & 15;
+    const __m128i *block = (const __m128i *) (text - offset);
+    unsigned mask = (0xFFFFu << offset) & 0xFFFFu;
+
+    for (;; block++, mask = 0xFFFFu) {
+        __m128i shifted = _mm_sub_epi8(_mm_load_si128(block), one);
+        __m128i space = _mm_cmpeq_epi8(_mm_min_epu8(shifted, limit), shifted);
+        unsigned stops = ~(unsigned) _mm_movemask_epi8(space) & mask;
+        if (stops != 0) {
+            return (const char *) block + __builtin_ctz(stops);
+        }
+    }
+}
+
+// Stops are quotes, backslashes and bytes below 0x20, which are the ones
+// with min(b, 31) == b
+JSON_SCAN_VECTOR("sse2") static const char *
+_jsonScan_FindSpecialSSE2(const char *text)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i limit = _mm_set1_epi8(31);
+    uintptr_t offset = (uintptr_t) text & 15;
+    const __m128i *block = (const __m128i *) (text - offset);
+    unsigned mask = 0xFFFFu << offset;
+
+    for (;; block++, mask = 0xFFFFu) {
+        __m128i bytes = _mm_load_si128(block);
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, quote), _mm_cmpeq_epi8(bytes, backslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(bytes, limit), bytes));
+        unsigned stops = (unsigned) _mm_movemask_epi8(special) & mask;
+        if (stops != 0) {
+            return (const char *) block + __builtin_ctz(stops);
+        }
+    }
+}
+
+JSON_SCAN_VECTOR("avx2") static const char *
+_jsonScan_SkipSpaceAVX2(const char *text)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i limit = _mm256_set1_epi8(31);
+    uintptr_t offset = (uintptr_t) text & 31;
+    const __m256i *block = (const __m256i *) (text - offset);
+    uint32_t mask = 0xFFFFFFFFu << offset;
+
+    for (;; block++, mask = 0xFFFFFFFFu) {
+        __m256i shifted = _mm256_sub_epi8(_mm256_load_si256(block), one);
+        __m256i space = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, limit), shifted);
+        uint32_t stops = ~(uint32_t) _mm256_movemask_epi8(space) & mask;
+        if (stops != 0) {
+            return (const char *) block + __builtin_ctz(stops);
+        }
+    }
+}
+
+JSON_SCAN_VECTOR("avx2") static const char *
+_jsonScan_FindSpecialAVX2(const char *text)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i limit = _mm256_set1_epi8(31);
+    uintptr_t offset = (uintptr_t) text & 31;
+    const __m256i *block = (const __m256i *) (text - offset);
+    uint32_t mask = 0xFFFFFFFFu << offset;
+
+    for (;; block++, mask = 0xFFFFFFFFu) {
+        __m256i bytes = _mm256_load_si256(block);
+        __m256i special = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, quote), _mm256_cmpeq_epi8(bytes, backslash)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, limit), bytes));
+        uint32_t stops = (uint32_t) _mm256_movemask_epi8(special) & mask;
+        if (stops != 0) {
+            return (const char *) block + __builtin_ctz(stops);
+        }
+    }
+}
+
+#endif // JSON_SCAN_X86
+
+static const char *_jsonScan_ResolveSkipSpace(const char *text);
+static const char *_jsonScan_ResolveFindSpecial(const char *text);
+
+// Both start out pointing at resolvers that pick the best implementation on
+// first use. Racing threads pick the same one, so plain atomic stores do.
+static JSONScanner _skipSpace = _jsonScan_ResolveSkipSpace;
+static JSONScanner _findSpecial = _jsonScan_ResolveFindSpecial;
+
+static void
+_jsonScan_Resolve()
+{
+    JSONScanner skipSpace = _jsonScan_SkipSpaceScalar;
+    JSONScanner findSpecial = _jsonScan_FindSpecialScalar;
+
+#ifdef JSON_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        skipSpace = _jsonScan_SkipSpaceAVX2;
+        findSpecial = _jsonScan_FindSpecialAVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        skipSpace = _jsonScan_SkipSpaceSSE2;
+        findSpecial = _jsonScan_FindSpecialSSE2;
+    }
+#endif
+
+    __atomic_store_n(&_skipSpace, skipSpace, __ATOMIC_RELAXED);
+    __atomic_store_n(&_findSpecial, findSpecial, __ATOMIC_RELAXED);
+}
+
+static const char *
+_jsonScan_ResolveSkipSpace(const char *text)
+{
+    _jsonScan_Resolve();
+    return __atomic_load_n(&_skipSpace, __ATOMIC_RELAXED)(text);
+}
+
+static const char *
+_jsonScan_ResolveFindSpecial(const char *text)
+{
+    _jsonScan_Resolve();
+    return __atomic_load_n(&_findSpecial, __ATOMIC_RELAXED)(text);
+}
+
+const char *
+jsonScan_SkipSpace(const char *text)
+{
+    // Most tokens are not preceded by any space at all
+    if (*text == '\0' || (unsigned char) *text > 32) {
+        return text;
+    }
+    return __atomic_load_n(&_skipSpace, __ATOMIC_RELAXED)(text);
+}
+
+const char *
+jsonScan_FindSpecial(const char *text)
+{
+    return __atomic_load_n(&_findSpecial, __ATOMIC_RELAXED)(text);
+}
@@ -0,0 +1,36 @@
+#ifndef libcool_internal_encoding_json_scan_
+#define libcool_internal_encoding_json_scan_
+
+/**
+ * Return the first byte at or after `text` that is not whitespace in
+ * cJSON's sense, any byte from 1 to 32, so a NUL terminator always stops
+ * the scan. `text` must be NUL-terminated.
+ *
+ * Uses AVX2 or SSE2 where the CPU has them, chosen on first use, and
+ * scans a byte at a time elsewhere. The vector scans read whole aligned
+ * blocks and so may look at bytes past the terminator, though never past
+ * the page it lies in.
+ */
+const char *jsonScan_SkipSpace(const char *text);
+
+/**
+ * Return the first byte at or after `text` that needs attention inside a
+ * JSON string: a quote, a backslash or a control character, including
+ * the NUL terminator. Everything before it can be copied as is.
+ *
+ * Example:
+ * @code
+ * {
+ *     const char *end = jsonScan_FindSpecial(p);
+ *     memcpy(out, p, end - p);
+ *     out += end - p;
+ *     p = end;
+ *     if (*p == '\\') {
+ *         ... // handle the escape
+ *     }
+ * }
+ * @endcode
+ */
+const char *jsonScan_FindSpecial(const char *text);
+
+#endif // libcool_internal_encoding_json_scan_
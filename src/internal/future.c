@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "future.h"
+#include "parker.h"
+#include "slab.h"
+
+typedef struct future_waiter FutureWaiter;
+
+// Either a parked thread or a continuation
+struct future_waiter {
+    FutureWaiter *next;
+    Parker *parker;
+    int woken; // set once the completer is done with a parked waiter's node
+    void (*callback)(void *context, void *result);
+    void *context;
+};
+
+// `waiters` is a stack of pending waiters until the future completes, and
+// then the FUTURE_DONE marker, so adding a waiter and completing are each a
+// single atomic operation on it
+#define FUTURE_DONE ((FutureWaiter *) 1)
+
+struct future {
+    int refcount;
+    FutureWaiter *waiters;
+    void *result;
+    void (*release)(void *result);
+};
+
+Future *
+future_Create(void (*release)(void *result))
+{
+    Future *future = (Future *) slab_Allocate(sizeof(Future));
+    future->refcount = 1;
+    future->waiters = NULL;
+    future->result = NULL;
+    future->release = release;
+    return future;
+}
+
+Future *
+future_Retain(Future *future)
+{
+    __sync_fetch_and_add(&future->refcount, 1);
+    return future;
+}
+
+void
+future_Release(Future *future)
+{
+    if (__sync_sub_and_fetch(&future->refcount, 1) > 0) {
+        return;
+    }
+    if (future_IsDone(future) && future->release != NULL && future->result != NULL) {
+        future->release(future->result);
+    }
+    slab_Free(future, sizeof(Future));
+}
+
+// Push `waiter` unless the future is already done; returns 0 if it was
+static int
+_future_AddWaiter(Future *future, FutureWaiter *waiter)
+{
+    FutureWaiter *head = __atomic_load_n(&future->waiters, __ATOMIC_ACQUIRE);
+    do {
+        if (head == FUTURE_DONE) {
+            return 0;
+        }
+        waiter->next = head;
+    } while (!__atomic_compare_exchange_n(&future->waiters, &head, waiter, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return 1;
+}
+
+void
+future_Complete(Future *future, void *result)
+{
+    future->result = result;
+    FutureWaiter *waiters = __atomic_exchange_n(&future->waiters, FUTURE_DONE, __ATOMIC_ACQ_REL);
+
+    // Waiters were pushed newest first; reverse so continuations run in the
+    // order they were attached
+    FutureWaiter *ordered = NULL;
+    while (waiters != NULL) {
+        FutureWaiter *next = waiters->next;
+        waiters->next = ordered;
+        ordered = waiters;
+        waiters = next;
+    }
+
+    while (ordered != NULL) {
+        FutureWaiter *next = ordered->next;
+        if (ordered->parker != NULL) {
+            // The node lives on the waiter's stack and may be gone as soon
+            // as `woken` is set
+            Parker *parker = ordered->parker;
+            __atomic_store_n(&ordered->woken, 1, __ATOMIC_RELEASE);
+            parker_Unpark(parker);
+        } else {
+            ordered->callback(ordered->context, result);
+            slab_Free(ordered, sizeof(FutureWaiter));
+        }
+        ordered = next;
+    }
+}
+
+int
+future_IsDone(Future *future)
+{
+    return __atomic_load_n(&future->waiters, __ATOMIC_ACQUIRE) == FUTURE_DONE;
+}
+
+void *
+future_Wait(Future *future)
+{
+    // On a worker this parks the calling fiber, not the thread
+    FutureWaiter waiter;
+    waiter.parker = parker_GetThreadParker();
+    waiter.woken = 0;
+    waiter.callback = NULL;
+    waiter.context = NULL;
+
+    if (_future_AddWaiter(future, &waiter)) {
+        while (!__atomic_load_n(&waiter.woken, __ATOMIC_ACQUIRE)) {
+            parker_Park(waiter.parker);
+        }
+    }
+
+    return future->result;
+}
+
+void
+future_Then(Future *future, void (*callback)(void *context, void *result), void *context)
+{
+    FutureWaiter *waiter = (FutureWaiter *) slab_Allocate(sizeof(FutureWaiter));
+    waiter->parker = NULL;
+    waiter->woken = 0;
+    waiter->callback = callback;
+    waiter->context = context;
+
+    if (!_future_AddWaiter(future, waiter)) {
+        slab_Free(waiter, sizeof(FutureWaiter));
+        callback(context, future->result);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef libcool_internal_future_
+#define libcool_internal_future_
+
+typedef struct future Future;
+
+/**
+ * Create a pending future holding one reference. The result, once set,
+ * belongs to the future and is handed to `release` when the last reference
+ * goes away.
+ *
+ * @param [in] release Frees a result, or NULL to leave results alone.
+ *
+ * Example:
+ * @code
+ * {
+ *     Future *future = future_Create((void (*)(void *)) value_Delete);
+ *     actor_SendMessageAsync(actor, message, future_Retain(future));
+ *     Value *reply = (Value *) future_Wait(future);
+ *     ...
+ *     future_Release(future);
+ * }
+ * @endcode
+ */
+Future *future_Create(void (*release)(void *result));
+Future *future_Retain(Future *future);
+void future_Release(Future *future);
+
+/**
+ * Set the result of `future`, wake every thread waiting on it and run its
+ * continuations on the calling thread. A future is completed exactly once.
+ */
+void future_Complete(Future *future, void *result);
+
+int future_IsDone(Future *future);
+
+/**
+ * Block until `future` is completed. On a scheduler worker only the calling
+ * fiber waits, so the task that completes the future can still get a thread.
+ *
+ * @return The result, still owned by the future.
+ */
+void *future_Wait(Future *future);
+
+/**
+ * Call `callback(context, result)` once `future` is completed: right away
+ * if it already is, otherwise on the thread that completes it. The callback
+ * should be short; long work belongs on the scheduler.
+ */
+void future_Then(Future *future, void (*callback)(void *context, void *result), void *context);
+
+#endif // libcool_internal_future_
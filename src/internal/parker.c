@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "parker.h"
+
+#define PARKER_EMPTY 0
+#define PARKER_NOTIFIED 1
+#define PARKER_PARKED -1
+
+static __thread Parker _threadParker;
+static __thread int _threadParkerReady;
+static __thread Parker *_currentParker;
+
+#ifdef __linux__
+static void
+_parker_Wait(Parker *parker)
+{
+    syscall(SYS_futex, &parker->state, FUTEX_WAIT_PRIVATE, PARKER_PARKED, NULL, NULL, 0);
+}
+
+static void
+_parker_Wake(Parker *parker)
+{
+    syscall(SYS_futex, &parker->state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+#else
+static void
+_parker_Wait(Parker *parker)
+{
+    pthread_mutex_lock(&parker->mutex);
+    while (__atomic_load_n(&parker->state, __ATOMIC_ACQUIRE) == PARKER_PARKED) {
+        pthread_cond_wait(&parker->cond, &parker->mutex);
+    }
+    pthread_mutex_unlock(&parker->mutex);
+}
+
+static void
+_parker_Wake(Parker *parker)
+{
+    pthread_mutex_lock(&parker->mutex);
+    pthread_cond_signal(&parker->cond);
+    pthread_mutex_unlock(&parker->mutex);
+}
+#endif
+
+void
+parker_Init(Parker *parker)
+{
+    parker->state = PARKER_EMPTY;
+    parker->suspend = NULL;
+    parker->resume = NULL;
+#ifndef __linux__
+    pthread_mutex_init(&parker->mutex, NULL);
+    pthread_cond_init(&parker->cond, NULL);
+#endif
+}
+
+void
+parker_Destroy(Parker *parker)
+{
+#ifndef __linux__
+    pthread_mutex_destroy(&parker->mutex);
+    pthread_cond_destroy(&parker->cond);
+#endif
+}
+
+void
+parker_Park(Parker *parker)
+{
+    // NOTIFIED -> EMPTY consumes the permit, EMPTY -> PARKED goes to sleep
+    if (__atomic_sub_fetch(&parker->state, 1, __ATOMIC_ACQUIRE) == PARKER_EMPTY) {
+        return;
+    }
+
+    for (;;) {
+        if (parker->suspend != NULL) {
+            parker->suspend(parker);
+        } else {
+            _parker_Wait(parker);
+        }
+        int notified = PARKER_NOTIFIED;
+        if (__atomic_compare_exchange_n(&parker->state, &notified, PARKER_EMPTY, 0,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        // Spurious wakeup: still PARKED
+    }
+}
+
+void
+parker_Unpark(Parker *parker)
+{
+    if (__atomic_exchange_n(&parker->state, PARKER_NOTIFIED, __ATOMIC_RELEASE) == PARKER_PARKED) {
+        if (parker->resume != NULL) {
+            parker->resume(parker);
+        } else {
+            _parker_Wake(parker);
+        }
+    }
+}
+
+Parker *
+parker_GetThreadParker()
+{
+    if (_currentParker != NULL) {
+        return _currentParker;
+    }
+    if (!_threadParkerReady) {
+        parker_Init(&_threadParker);
+        _threadParkerReady = 1;
+    }
+    return &_threadParker;
+}
+
+void
+parker_SetThreadParker(Parker *parker)
+{
+    _currentParker = parker;
+}
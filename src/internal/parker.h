@@ -0,0 +1,71 @@
+#ifndef libcool_internal_parker_
+#define libcool_internal_parker_
+
+#ifndef __linux__
+#include <pthread.h>
+#endif
+
+typedef struct parker Parker;
+
+// One-shot wakeup permit for a single waiting thread. On Linux parking is a
+// futex wait on `state`; elsewhere it falls back to a mutex and condition
+// variable, which are only touched when a thread actually parks.
+//
+// A parker belonging to a scheduler fiber sets `suspend` and `resume`:
+// parking then switches the worker to other work instead of blocking it, and
+// unparking makes the fiber runnable again.
+struct parker {
+    int state;
+    void (*suspend)(Parker *parker);
+    void (*resume)(Parker *parker);
+#ifndef __linux__
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+};
+
+void parker_Init(Parker *parker);
+void parker_Destroy(Parker *parker);
+
+/**
+ * Block the calling thread until `parker` is unparked. If it was unparked
+ * since the last park, consume that permit and return immediately. Only one
+ * thread may park on a given parker.
+ *
+ * Example:
+ * @code
+ * {
+ *     // consumer
+ *     while ((item = queue_TryPop(queue)) == NULL) {
+ *         parker_Park(&queue->parker);
+ *     }
+ *
+ *     // producer
+ *     queue_Push(queue, item);
+ *     parker_Unpark(&queue->parker);
+ * }
+ * @endcode
+ */
+void parker_Park(Parker *parker);
+
+/**
+ * Wake the thread parked on `parker`, or leave a permit so that its next
+ * park returns immediately. Makes a system call only if a thread is parked.
+ */
+void parker_Unpark(Parker *parker);
+
+/**
+ * Return the calling thread's own parker, for waiting on anything another
+ * thread completes. Each wait must re-check its condition after parking,
+ * since a permit can be left over from an earlier wait.
+ */
+Parker *parker_GetThreadParker();
+
+/**
+ * Make `parker` the one `parker_GetThreadParker` returns on the calling
+ * thread, or restore the thread's own with NULL. The scheduler points it at
+ * whichever fiber a worker is running.
+ */
+void parker_SetThreadParker(Parker *parker);
+
+#endif // libcool_internal_parker_
@@ -0,0 +1,357 @@
+#ifdef __APPLE__
+#define _XOPEN_SOURCE 600 // ucontext is only declared in XSI mode
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#include "scheduler.h"
+#include "parker.h"
+
+#define SCHEDULER_QUEUE_CAPACITY 64
+
+// Stack reserved for each extra fiber, as much as a thread gets by default.
+// Pages are only committed as they are touched.
+#define SCHEDULER_FIBER_STACK_SIZE (8 * 1024 * 1024)
+
+typedef struct scheduler_worker SchedulerWorker;
+typedef struct scheduler_fiber SchedulerFiber;
+
+// A stack running the worker loop. A task that parks on the fiber's parker,
+// as `<-` and `await` do, suspends the fiber, and the worker carries on with
+// another one. Fibers stay on the worker that created them.
+struct scheduler_fiber {
+    Parker parker;
+    ucontext_t context;
+    void *stack; // NULL for the worker thread's own stack
+    SchedulerWorker *worker;
+    SchedulerFiber *next;
+};
+
+// Ring buffer of runnable tasks owned by one worker
+struct scheduler_worker {
+    pthread_mutex_t mutex;
+    SchedulerTask **tasks;
+    size_t capacity;
+    size_t head;
+    size_t count;
+
+    // Suspended fibers that have been unparked, guarded by `mutex`
+    SchedulerFiber *readyHead;
+    SchedulerFiber *readyTail;
+
+    // Fibers idling at the top of the worker loop, only touched by the worker
+    SchedulerFiber *spare;
+    SchedulerFiber *current;
+
+    size_t index;
+    pthread_t thread;
+};
+
+static pthread_once_t _schedulerOnce = PTHREAD_ONCE_INIT;
+static SchedulerWorker *_workers;
+static size_t _workerCount;
+static size_t _nextWorker;
+
+// Tasks queued anywhere, and workers parked because there were none
+static size_t _pending;
+static size_t _idle;
+static pthread_mutex_t _idleMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _idleCond = PTHREAD_COND_INITIALIZER;
+
+static __thread SchedulerWorker *_currentWorker;
+
+static void
+_worker_Push(SchedulerWorker *worker, SchedulerTask *task)
+{
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->count == worker->capacity) {
+        SchedulerTask **tasks = (SchedulerTask **) malloc(sizeof(SchedulerTask *) * worker->capacity * 2);
+        for (size_t i = 0; i < worker->count; i++) {
+            tasks[i] = worker->tasks[(worker->head + i) % worker->capacity];
+        }
+        free(worker->tasks);
+        worker->tasks = tasks;
+        worker->head = 0;
+        worker->capacity *= 2;
+    }
+    worker->tasks[(worker->head + worker->count) % worker->capacity] = task;
+    worker->count++;
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+static SchedulerTask *
+_worker_Pop(SchedulerWorker *worker)
+{
+    SchedulerTask *task = NULL;
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->count > 0) {
+        task = worker->tasks[worker->head];
+        worker->head = (worker->head + 1) % worker->capacity;
+        worker->count--;
+    }
+    pthread_mutex_unlock(&worker->mutex);
+    return task;
+}
+
+// Take a task from our own queue first, then from the other workers in turn
+static SchedulerTask *
+_worker_Next(SchedulerWorker *worker)
+{
+    SchedulerTask *task = _worker_Pop(worker);
+    for (size_t i = 1; task == NULL && i < _workerCount; i++) {
+        task = _worker_Pop(&_workers[(worker->index + i) % _workerCount]);
+    }
+    if (task != NULL) {
+        __sync_sub_and_fetch(&_pending, 1);
+    }
+    return task;
+}
+
+static int
+_worker_HasReady(SchedulerWorker *worker)
+{
+    return __atomic_load_n(&worker->readyHead, __ATOMIC_SEQ_CST) != NULL;
+}
+
+static SchedulerFiber *
+_worker_PopReady(SchedulerWorker *worker)
+{
+    if (!_worker_HasReady(worker)) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&worker->mutex);
+    SchedulerFiber *fiber = worker->readyHead;
+    if (fiber != NULL) {
+        __atomic_store_n(&worker->readyHead, fiber->next, __ATOMIC_SEQ_CST);
+        if (fiber->next == NULL) {
+            worker->readyTail = NULL;
+        }
+    }
+    pthread_mutex_unlock(&worker->mutex);
+    return fiber;
+}
+
+// Run `fiber` on the calling worker, leaving the current one where it is
+static void
+_fiber_SwitchTo(SchedulerWorker *worker, SchedulerFiber *fiber)
+{
+    SchedulerFiber *self = worker->current;
+    worker->current = fiber;
+    parker_SetThreadParker(&fiber->parker);
+    swapcontext(&self->context, &fiber->context);
+}
+
+static void _worker_Loop(SchedulerWorker *worker);
+
+static void
+_fiber_Start()
+{
+    _worker_Loop(_currentWorker);
+}
+
+static void _fiber_Suspend(Parker *parker);
+static void _fiber_Resume(Parker *parker);
+
+static SchedulerFiber *
+_fiber_Create(SchedulerWorker *worker, int ownStack)
+{
+    SchedulerFiber *fiber = (SchedulerFiber *) calloc(1, sizeof(SchedulerFiber));
+    parker_Init(&fiber->parker);
+    fiber->parker.suspend = _fiber_Suspend;
+    fiber->parker.resume = _fiber_Resume;
+    fiber->worker = worker;
+
+    if (ownStack) {
+        // The lowest page is left inaccessible to catch overflows
+        long page = sysconf(_SC_PAGESIZE);
+        fiber->stack = mmap(NULL, SCHEDULER_FIBER_STACK_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (fiber->stack == MAP_FAILED) {
+            fprintf(stderr, "Unable to allocate a fiber stack\n");
+            abort();
+        }
+        mprotect(fiber->stack, page, PROT_NONE);
+
+        getcontext(&fiber->context);
+        fiber->context.uc_stack.ss_sp = fiber->stack;
+        fiber->context.uc_stack.ss_size = SCHEDULER_FIBER_STACK_SIZE;
+        fiber->context.uc_link = NULL;
+        makecontext(&fiber->context, _fiber_Start, 0);
+    }
+
+    return fiber;
+}
+
+// Park hook for fibers: hand the worker to a fiber that is ready to run, or
+// failing that to a spare or new one running the worker loop. We come back
+// here once something has unparked us and the worker has picked us up.
+static void
+_fiber_Suspend(Parker *parker)
+{
+    SchedulerFiber *self = (SchedulerFiber *) parker;
+    SchedulerWorker *worker = self->worker;
+
+    SchedulerFiber *next = _worker_PopReady(worker);
+    if (next == self) {
+        // Unparked before we got as far as switching
+        return;
+    }
+    if (next == NULL && (next = worker->spare) != NULL) {
+        worker->spare = next->next;
+    }
+    if (next == NULL) {
+        next = _fiber_Create(worker, 1);
+    }
+    _fiber_SwitchTo(worker, next);
+}
+
+// Unpark hook for fibers, run by whichever thread completed the wait. The
+// fiber is queued on its own worker, which is the only thread that ever
+// switches to it, so it is already off the processor by the time it runs.
+static void
+_fiber_Resume(Parker *parker)
+{
+    SchedulerFiber *fiber = (SchedulerFiber *) parker;
+    SchedulerWorker *worker = fiber->worker;
+
+    pthread_mutex_lock(&worker->mutex);
+    fiber->next = NULL;
+    if (worker->readyTail == NULL) {
+        __atomic_store_n(&worker->readyHead, fiber, __ATOMIC_SEQ_CST);
+    } else {
+        worker->readyTail->next = fiber;
+    }
+    worker->readyTail = fiber;
+    pthread_mutex_unlock(&worker->mutex);
+
+    // The worker may be idle, and only it can run the fiber
+    if (__sync_fetch_and_add(&_idle, 0) > 0) {
+        pthread_mutex_lock(&_idleMutex);
+        pthread_cond_broadcast(&_idleCond);
+        pthread_mutex_unlock(&_idleMutex);
+    }
+}
+
+static void
+_worker_Loop(SchedulerWorker *worker)
+{
+    for (;;) {
+        // Resumed fibers go first. This one waits as a spare until a fiber
+        // suspends and needs a loop to hand the worker to.
+        SchedulerFiber *fiber = _worker_PopReady(worker);
+        if (fiber != NULL) {
+            SchedulerFiber *self = worker->current;
+            self->next = worker->spare;
+            worker->spare = self;
+            _fiber_SwitchTo(worker, fiber);
+            continue;
+        }
+
+        SchedulerTask *task = _worker_Next(worker);
+        if (task != NULL) {
+            task->run(task);
+            continue;
+        }
+
+        // Announce that we are idle before the final check, so that a
+        // submitter either sees us waiting or we see its task
+        pthread_mutex_lock(&_idleMutex);
+        __sync_add_and_fetch(&_idle, 1);
+        while (__sync_fetch_and_add(&_pending, 0) == 0 && !_worker_HasReady(worker)) {
+            pthread_cond_wait(&_idleCond, &_idleMutex);
+        }
+        __sync_sub_and_fetch(&_idle, 1);
+        pthread_mutex_unlock(&_idleMutex);
+    }
+}
+
+static void *
+_worker_Run(void *arg)
+{
+    SchedulerWorker *worker = (SchedulerWorker *) arg;
+    _currentWorker = worker;
+
+    // The thread's own stack is the worker's first fiber
+    worker->current = _fiber_Create(worker, 0);
+    parker_SetThreadParker(&worker->current->parker);
+
+    _worker_Loop(worker);
+    return NULL;
+}
+
+static void
+_scheduler_Init()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    _workerCount = cpus > 0 ? (size_t) cpus : 1;
+    _workers = (SchedulerWorker *) calloc(_workerCount, sizeof(SchedulerWorker));
+
+    for (size_t i = 0; i < _workerCount; i++) {
+        SchedulerWorker *worker = &_workers[i];
+        pthread_mutex_init(&worker->mutex, NULL);
+        worker->capacity = SCHEDULER_QUEUE_CAPACITY;
+        worker->tasks = (SchedulerTask **) malloc(sizeof(SchedulerTask *) * worker->capacity);
+        worker->index = i;
+    }
+
+    for (size_t i = 0; i < _workerCount; i++) {
+        pthread_create(&_workers[i].thread, NULL, _worker_Run, &_workers[i]);
+    }
+}
+
+void
+scheduler_Submit(SchedulerTask *task)
+{
+    pthread_once(&_schedulerOnce, _scheduler_Init);
+
+    SchedulerWorker *worker = _currentWorker;
+    if (worker == NULL) {
+        worker = &_workers[__sync_fetch_and_add(&_nextWorker, 1) % _workerCount];
+    }
+
+    // Count the task before it is visible so _pending never underflows
+    __sync_add_and_fetch(&_pending, 1);
+    _worker_Push(worker, task);
+
+    if (__sync_fetch_and_add(&_idle, 0) > 0) {
+        pthread_mutex_lock(&_idleMutex);
+        pthread_cond_signal(&_idleCond);
+        pthread_mutex_unlock(&_idleMutex);
+    }
+}
+
+int
+scheduler_RunOne()
+{
+    if (_currentWorker == NULL) {
+        return 0;
+    }
+
+    SchedulerTask *task = _worker_Next(_currentWorker);
+    if (task == NULL) {
+        return 0;
+    }
+    task->run(task);
+    return 1;
+}
+
+int
+scheduler_IsWorker()
+{
+    return _currentWorker != NULL;
+}
+
+size_t
+scheduler_GetWorkerCount()
+{
+    pthread_once(&_schedulerOnce, _scheduler_Init);
+    return _workerCount;
+}
@@ -0,0 +1,67 @@
+#ifndef libcool_internal_scheduler_
+#define libcool_internal_scheduler_
+
+#include <stddef.h>
+
+typedef struct scheduler_task SchedulerTask;
+
+// Unit of work for the scheduler, normally embedded in the object it runs
+struct scheduler_task {
+    void (*run)(SchedulerTask *task);
+};
+
+/**
+ * Queue `task` to run once on one of the scheduler's worker threads. The
+ * workers, one per online CPU, are started by the first submission. A task
+ * submitted from a worker goes on that worker's own run queue; idle workers
+ * steal from the others.
+ *
+ * A task must not be submitted again until it has started running.
+ *
+ * Tasks run on fibers. A task that waits on `parker_GetThreadParker()`, as
+ * `channelMessage_Wait` and `future_Wait` do, suspends only its fiber: the
+ * worker goes on running other tasks on another stack and picks the fiber
+ * up again once it is unparked. Waiting never ties up a worker, however
+ * deep the chain of waiting tasks.
+ *
+ * @param [in] task The task to run. It must stay valid until it has run.
+ *
+ * Example:
+ * @code
+ * {
+ *     typedef struct { SchedulerTask task; int value; } Job;
+ *
+ *     static void job_Run(SchedulerTask *task) {
+ *         Job *job = (Job *) task;
+ *         ...
+ *     }
+ *
+ *     Job *job = malloc(sizeof(Job));
+ *     job->task.run = job_Run;
+ *     scheduler_Submit(&job->task);
+ * }
+ * @endcode
+ */
+void scheduler_Submit(SchedulerTask *task);
+
+/**
+ * Run one queued task on the calling worker thread, taking it from the
+ * worker's own queue or stealing it from another. Workers that would
+ * otherwise block waiting for another task use this to keep the pool
+ * making progress.
+ *
+ * @return 1 if a task was run, 0 if there was none or the caller is not a worker.
+ */
+int scheduler_RunOne();
+
+/**
+ * Return 1 if the calling thread is one of the scheduler's workers.
+ */
+int scheduler_IsWorker();
+
+/**
+ * Return the number of worker threads, starting them if needed.
+ */
+size_t scheduler_GetWorkerCount();
+
+#endif // libcool_internal_scheduler_
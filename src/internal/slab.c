@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "slab.h"
+
+#define SLAB_CHUNK_SIZE (64 * 1024)
+#define SLAB_BATCH_SIZE 64
+#define SLAB_CACHE_LIMIT (4 * SLAB_BATCH_SIZE)
+#define SLAB_STATS_BATCH 64
+#define SLAB_MAX_SIZE 512
+#define SLAB_NUM_CLASSES 10
+
+static const size_t _classSizes[SLAB_NUM_CLASSES] = { 16, 32, 48, 64, 96, 128, 192, 256, 384, 512 };
+
+struct slab_free_object;
+typedef struct slab_free_object SlabFreeObject;
+
+struct slab_free_object {
+    SlabFreeObject *next;
+};
+
+// Per-thread free lists, one per size class
+typedef struct slab_thread_cache {
+    SlabFreeObject *freeList[SLAB_NUM_CLASSES];
+    size_t freeCount[SLAB_NUM_CLASSES];
+    long liveDelta;
+} SlabThreadCache;
+
+// Shared depot that thread caches refill from and spill into
+typedef struct slab_depot {
+    pthread_mutex_t mutex;
+    SlabFreeObject *freeList;
+    size_t freeCount;
+} SlabDepot;
+
+static SlabDepot _depots[SLAB_NUM_CLASSES];
+static uint8_t _classIndex[(SLAB_MAX_SIZE / 16) + 1];
+
+static pthread_once_t _slabOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t _cacheKey;
+static __thread SlabThreadCache *_threadCache;
+
+// Signed, since a thread freeing objects another thread allocated can flush
+// its share of the count before the allocating thread does
+static long _live;
+static size_t _peak;
+
+static void _cache_Destroy(void *cache);
+
+static void
+_slab_Init()
+{
+    int class = 0;
+    for (size_t i = 0; i <= SLAB_MAX_SIZE / 16; i++) {
+        while (_classSizes[class] < i * 16) {
+            class++;
+        }
+        _classIndex[i] = class;
+    }
+
+    for (int i = 0; i < SLAB_NUM_CLASSES; i++) {
+        pthread_mutex_init(&_depots[i].mutex, NULL);
+        _depots[i].freeList = NULL;
+        _depots[i].freeCount = 0;
+    }
+
+    pthread_key_create(&_cacheKey, _cache_Destroy);
+}
+
+static int
+_slab_ClassOf(size_t size)
+{
+    return _classIndex[(size + 15) / 16];
+}
+
+static void
+_stats_Flush(SlabThreadCache *cache)
+{
+    long sum = __sync_add_and_fetch(&_live, cache->liveDelta);
+    size_t live = sum > 0 ? (size_t) sum : 0;
+    cache->liveDelta = 0;
+
+    size_t peak = __atomic_load_n(&_peak, __ATOMIC_RELAXED);
+    while (live > peak && !__sync_bool_compare_and_swap(&_peak, peak, live)) {
+        peak = __atomic_load_n(&_peak, __ATOMIC_RELAXED);
+    }
+}
+
+static void
+_stats_Update(SlabThreadCache *cache, long delta)
+{
+    cache->liveDelta += delta;
+    if (cache->liveDelta >= SLAB_STATS_BATCH || cache->liveDelta <= -SLAB_STATS_BATCH) {
+        _stats_Flush(cache);
+    }
+}
+
+static SlabThreadCache *
+_cache_Get()
+{
+    if (_threadCache == NULL) {
+        pthread_once(&_slabOnce, _slab_Init);
+        _threadCache = (SlabThreadCache *) calloc(1, sizeof(SlabThreadCache));
+        pthread_setspecific(_cacheKey, _threadCache);
+    }
+    return _threadCache;
+}
+
+static void
+_depot_Push(int class, SlabFreeObject *first, SlabFreeObject *last, size_t count)
+{
+    SlabDepot *depot = &_depots[class];
+    pthread_mutex_lock(&depot->mutex);
+    last->next = depot->freeList;
+    depot->freeList = first;
+    depot->freeCount += count;
+    pthread_mutex_unlock(&depot->mutex);
+}
+
+// Keep the `keep` most recently freed objects and move the rest to the depot
+static void
+_cache_Spill(SlabThreadCache *cache, int class, size_t keep)
+{
+    SlabFreeObject *first = cache->freeList[class];
+    size_t count = cache->freeCount[class];
+    if (first == NULL || count <= keep) {
+        return;
+    }
+
+    if (keep == 0) {
+        cache->freeList[class] = NULL;
+    } else {
+        SlabFreeObject *boundary = first;
+        for (size_t i = 1; i < keep; i++) {
+            boundary = boundary->next;
+        }
+        first = boundary->next;
+        boundary->next = NULL;
+    }
+
+    SlabFreeObject *last = first;
+    while (last->next != NULL) {
+        last = last->next;
+    }
+
+    cache->freeCount[class] = keep;
+    _depot_Push(class, first, last, count - keep);
+}
+
+static void
+_cache_Destroy(void *arg)
+{
+    SlabThreadCache *cache = (SlabThreadCache *) arg;
+    for (int class = 0; class < SLAB_NUM_CLASSES; class++) {
+        _cache_Spill(cache, class, 0);
+    }
+    _stats_Flush(cache);
+    free(cache);
+    _threadCache = NULL;
+}
+
+// Refill an empty thread list from the depot, or carve up a fresh chunk
+static void
+_cache_Refill(SlabThreadCache *cache, int class)
+{
+    SlabDepot *depot = &_depots[class];
+
+    pthread_mutex_lock(&depot->mutex);
+    if (depot->freeList != NULL) {
+        SlabFreeObject *first = depot->freeList;
+        SlabFreeObject *last = first;
+        size_t moved = 1;
+        while (moved < SLAB_BATCH_SIZE && last->next != NULL) {
+            last = last->next;
+            moved++;
+        }
+        depot->freeList = last->next;
+        depot->freeCount -= moved;
+        pthread_mutex_unlock(&depot->mutex);
+
+        last->next = NULL;
+        cache->freeList[class] = first;
+        cache->freeCount[class] = moved;
+        return;
+    }
+    pthread_mutex_unlock(&depot->mutex);
+
+    size_t objectSize = _classSizes[class];
+    size_t count = SLAB_CHUNK_SIZE / objectSize;
+    uint8_t *chunk = (uint8_t *) malloc(SLAB_CHUNK_SIZE);
+
+    SlabFreeObject *head = NULL;
+    for (size_t i = count; i > 0; i--) {
+        SlabFreeObject *object = (SlabFreeObject *) (chunk + (i - 1) * objectSize);
+        object->next = head;
+        head = object;
+    }
+
+    cache->freeList[class] = head;
+    cache->freeCount[class] = count;
+    _cache_Spill(cache, class, SLAB_BATCH_SIZE);
+}
+
+void *
+slab_Allocate(size_t size)
+{
+    SlabThreadCache *cache = _cache_Get();
+    _stats_Update(cache, 1);
+
+    if (size > SLAB_MAX_SIZE) {
+        return malloc(size);
+    }
+
+    int class = _slab_ClassOf(size);
+    if (cache->freeList[class] == NULL) {
+        _cache_Refill(cache, class);
+    }
+
+    SlabFreeObject *object = cache->freeList[class];
+    cache->freeList[class] = object->next;
+    cache->freeCount[class]--;
+
+    return (void *) object;
+}
+
+void
+slab_Free(void *pointer, size_t size)
+{
+    if (pointer == NULL) {
+        return;
+    }
+
+    SlabThreadCache *cache = _cache_Get();
+    _stats_Update(cache, -1);
+
+    if (size > SLAB_MAX_SIZE) {
+        free(pointer);
+        return;
+    }
+
+    int class = _slab_ClassOf(size);
+    SlabFreeObject *object = (SlabFreeObject *) pointer;
+    object->next = cache->freeList[class];
+    cache->freeList[class] = object;
+    cache->freeCount[class]++;
+
+    if (cache->freeCount[class] > SLAB_CACHE_LIMIT) {
+        _cache_Spill(cache, class, SLAB_CACHE_LIMIT - SLAB_BATCH_SIZE);
+    }
+}
+
+void *
+slab_Reallocate(void *pointer, size_t oldSize, size_t newSize)
+{
+    if (pointer == NULL) {
+        return newSize == 0 ? NULL : slab_Allocate(newSize);
+    } else if (newSize == 0) {
+        slab_Free(pointer, oldSize);
+        return NULL;
+    }
+
+    if (oldSize > SLAB_MAX_SIZE && newSize > SLAB_MAX_SIZE) {
+        return realloc(pointer, newSize);
+    } else if (oldSize <= SLAB_MAX_SIZE && newSize <= SLAB_MAX_SIZE
+            && _slab_ClassOf(oldSize) == _slab_ClassOf(newSize)) {
+        return pointer;
+    }
+
+    void *result = slab_Allocate(newSize);
+    memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+    slab_Free(pointer, oldSize);
+    return result;
+}
+
+SlabStats
+slab_GetStats()
+{
+    SlabThreadCache *cache = _cache_Get();
+    _stats_Flush(cache);
+
+    SlabStats stats;
+    long live = __atomic_load_n(&_live, __ATOMIC_RELAXED);
+    stats.live = live > 0 ? (size_t) live : 0;
+    stats.peak = __atomic_load_n(&_peak, __ATOMIC_RELAXED);
+    return stats;
+}
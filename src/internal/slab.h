@@ -0,0 +1,38 @@
+#ifndef libcool_internal_slab_
+#define libcool_internal_slab_
+
+#include <stddef.h>
+
+typedef struct slab_stats {
+    size_t live;
+    size_t peak;
+} SlabStats;
+
+/**
+ * Allocate `size` bytes from the size-class slabs. Requests larger than the
+ * biggest size class fall through to malloc. Memory is freed back to the
+ * calling thread's free list, so `size` must be given again when freeing.
+ *
+ * @param [in] size The number of bytes to allocate.
+ *
+ * Example:
+ * @code
+ * {
+ *     Value *value = (Value *) slab_Allocate(sizeof(Value));
+ *     ...
+ *     slab_Free(value, sizeof(Value));
+ * }
+ * @endcode
+ */
+void *slab_Allocate(size_t size);
+void *slab_Reallocate(void *pointer, size_t oldSize, size_t newSize);
+void slab_Free(void *pointer, size_t size);
+
+/**
+ * Report the number of objects currently allocated and the high water mark.
+ * Counters are folded in from each thread in batches, so the result may lag
+ * the true value by a few dozen objects per thread.
+ */
+SlabStats slab_GetStats();
+
+#endif // libcool_internal_slab_
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "symbol.h"
+
+#define SYMBOL_PAGE_SIZE 1024
+#define SYMBOL_MAX_PAGES 4096
+
+// Names are kept in fixed pages that never move, so symbol_Name can read
+// them without taking the table lock while another thread interns.
+static char **_namePages[SYMBOL_MAX_PAGES];
+static SymbolID _count;
+
+// Open-addressed table of IDs, -1 marking empty slots. Lookups read it
+// without the lock: a slot is published with a release store only after
+// its name is in place, and a full table is replaced by a bigger copy
+// rather than rehashed in place. Replaced tables are kept on `previous` and
+// never freed, since a reader may still be probing one; together they are
+// smaller than the current table.
+typedef struct symbol_table {
+    struct symbol_table *previous;
+    size_t capacity;
+    SymbolID slots[];
+} SymbolTable;
+
+static pthread_mutex_t _tableMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t _tableOnce = PTHREAD_ONCE_INIT;
+static SymbolTable *_table;
+
+static uint32_t
+_symbol_Hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *c = name; *c != '\0'; c++) {
+        hash = (hash ^ (uint8_t) *c) * 16777619u;
+    }
+    return hash;
+}
+
+static SymbolTable *
+_table_Create(size_t capacity)
+{
+    SymbolTable *table = (SymbolTable *) malloc(sizeof(SymbolTable) + sizeof(SymbolID) * capacity);
+    table->previous = NULL;
+    table->capacity = capacity;
+    memset(table->slots, 0xFF, sizeof(SymbolID) * capacity);
+    return table;
+}
+
+static void
+_table_Insert(SymbolTable *table, const char *name, SymbolID id)
+{
+    size_t index = _symbol_Hash(name) & (table->capacity - 1);
+    while (table->slots[index] >= 0) {
+        index = (index + 1) & (table->capacity - 1);
+    }
+    __atomic_store_n(&table->slots[index], id, __ATOMIC_RELEASE);
+}
+
+static void
+_table_Grow()
+{
+    SymbolTable *table = _table_Create(_table->capacity * 2);
+    table->previous = _table;
+    for (SymbolID id = 0; id < _count; id++) {
+        _table_Insert(table, symbol_Name(id), id);
+    }
+    __atomic_store_n(&_table, table, __ATOMIC_RELEASE);
+}
+
+static SymbolID
+_symbol_Add(const char *name)
+{
+    if ((size_t) (_count + 1) * 10 > _table->capacity * 7) {
+        _table_Grow();
+    }
+
+    SymbolID id = _count;
+    if (id % SYMBOL_PAGE_SIZE == 0) {
+        _namePages[id / SYMBOL_PAGE_SIZE] = (char **) malloc(sizeof(char *) * SYMBOL_PAGE_SIZE);
+    }
+
+    char *copy = (char *) malloc(strlen(name) + 1);
+    strcpy(copy, name);
+    _namePages[id / SYMBOL_PAGE_SIZE][id % SYMBOL_PAGE_SIZE] = copy;
+
+    _table_Insert(_table, copy, id);
+    _count++;
+
+    return id;
+}
+
+static void
+_symbol_Init()
+{
+    _table = _table_Create(256);
+    _symbol_Add("&"); // SymbolID_Ampersand
+}
+
+// Return the ID already interned for `name`, or -1. Safe without the lock,
+// though a name being interned by another thread may not be found yet.
+static SymbolID
+_symbol_Find(const char *name)
+{
+    SymbolTable *table = __atomic_load_n(&_table, __ATOMIC_ACQUIRE);
+    size_t index = _symbol_Hash(name) & (table->capacity - 1);
+    SymbolID id;
+    while ((id = __atomic_load_n(&table->slots[index], __ATOMIC_ACQUIRE)) >= 0) {
+        if (strcmp(symbol_Name(id), name) == 0) {
+            return id;
+        }
+        index = (index + 1) & (table->capacity - 1);
+    }
+    return -1;
+}
+
+SymbolID
+symbol_Intern(const char *name)
+{
+    pthread_once(&_tableOnce, _symbol_Init);
+
+    // Almost every call is for a name that is already there
+    SymbolID id = _symbol_Find(name);
+    if (id >= 0) {
+        return id;
+    }
+
+    pthread_mutex_lock(&_tableMutex);
+    id = _symbol_Find(name);
+    if (id >= 0) {
+        pthread_mutex_unlock(&_tableMutex);
+        return id;
+    }
+
+    if (_count == SYMBOL_PAGE_SIZE * SYMBOL_MAX_PAGES) {
+        fprintf(stderr, "Symbol table is full, unable to intern %s\n", name);
+        abort();
+    }
+
+    id = _symbol_Add(name);
+    pthread_mutex_unlock(&_tableMutex);
+
+    return id;
+}
+
+SymbolID
+symbol_Lookup(const char *name)
+{
+    pthread_once(&_tableOnce, _symbol_Init);
+    return _symbol_Find(name);
+}
+
+const char *
+symbol_Name(SymbolID id)
+{
+    return _namePages[id / SYMBOL_PAGE_SIZE][id % SYMBOL_PAGE_SIZE];
+}
@@ -0,0 +1,42 @@
+#ifndef libcool_internal_symbol_
+#define libcool_internal_symbol_
+
+typedef int SymbolID;
+
+// Symbols the evaluator checks for by ID, interned ahead of everything else
+enum {
+    SymbolID_Ampersand = 0
+};
+
+/**
+ * Return the unique ID for `name`, adding it to the global symbol table if
+ * this is the first time it has been seen. Two symbols are equal exactly
+ * when their IDs are equal. Names already in the table are found without
+ * taking a lock; only adding one does.
+ *
+ * @param [in] name A nul-terminated symbol name.
+ *
+ * Example:
+ * @code
+ * {
+ *     SymbolID id = symbol_Intern("fact");
+ *     printf("%s\n", symbol_Name(id)); // fact
+ * }
+ * @endcode
+ */
+SymbolID symbol_Intern(const char *name);
+
+/**
+ * Return the ID for `name` if it has already been interned, or -1 if it
+ * has not. Unlike `symbol_Intern`, this never adds to the table, so it is
+ * safe to call with names from untrusted input.
+ */
+SymbolID symbol_Lookup(const char *name);
+
+/**
+ * Return the interned name for `id`. The string lives as long as the
+ * process and must not be freed or modified.
+ */
+const char *symbol_Name(SymbolID id);
+
+#endif // libcool_internal_symbol_
@@ -2,6 +2,9 @@
 #include <stddef.h>
 #include <setjmp.h>
 #include <cmocka.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include "../actor.c"
 
@@ -9,11 +12,264 @@ static void test_actor_CreateLocal(void **state) {
     // assert_true(env != NULL);
 }
 
+// Replies with the replica's own metadata, so tests can tell replicas apart
+static void *
+_replica_Handle(void *metadata, void *message)
+{
+    return metadata;
+}
+
+static void
+_replica_Release(void *reply)
+{
+}
+
+static void test_actor_PoolRoundRobin(void **state) {
+    int first, second;
+    Actor *replicas[2];
+    replicas[0] = actor_CreateLocal(&first, _replica_Handle, _replica_Release);
+    replicas[1] = actor_CreateLocal(&second, _replica_Handle, _replica_Release);
+    Actor *pool = actor_CreatePool(replicas, 2, ActorPool_RoundRobin);
+    actor_Start(pool);
+
+    assert_ptr_equal(actor_SendMessageSync(pool, NULL), &first);
+    assert_ptr_equal(actor_SendMessageSync(pool, NULL), &second);
+    assert_ptr_equal(actor_SendMessageSync(pool, NULL), &first);
+}
+
+static void test_actor_PoolWorkSharing(void **state) {
+    int metadata[3];
+    Actor *replicas[3];
+    for (int i = 0; i < 3; i++) {
+        replicas[i] = actor_CreateLocal(&metadata[i], _replica_Handle, _replica_Release);
+    }
+    Actor *pool = actor_CreatePool(replicas, 3, ActorPool_WorkSharing);
+    actor_Start(pool);
+
+    Future *futures[100];
+    for (int i = 0; i < 100; i++) {
+        futures[i] = future_Create(NULL);
+        assert_true(actor_SendMessageAsync(pool, NULL, future_Retain(futures[i])));
+    }
+    for (int i = 0; i < 100; i++) {
+        int *reply = (int *) future_Wait(futures[i]);
+        assert_true(reply >= &metadata[0] && reply <= &metadata[2]);
+        future_Release(futures[i]);
+    }
+    assert_int_equal(actor_GetQueueDepth(pool), 0);
+}
+
+// An actor whose handler holds on to each message until the test opens the
+// gate, so that its mailbox can be filled deterministically. Waiting on the
+// gate suspends only the handler's fiber, so other actors keep running.
+static Future *_gate;
+static int _gateEntered;
+static int _released;
+
+static void *
+_gate_Handle(void *metadata, void *message)
+{
+    __atomic_add_fetch(&_gateEntered, 1, __ATOMIC_SEQ_CST);
+    future_Wait(_gate);
+    return message;
+}
+
+static void
+_gate_Release(void *message)
+{
+    __atomic_add_fetch(&_released, 1, __ATOMIC_SEQ_CST);
+}
+
+static void
+_gate_Reset()
+{
+    if (_gate != NULL) {
+        future_Release(_gate);
+    }
+    _gate = future_Create(NULL);
+    _gateEntered = 0;
+    _released = 0;
+}
+
+static void
+_gate_Open()
+{
+    future_Complete(_gate, NULL);
+}
+
+// A gated actor with a mailbox of one, busy with `first` and with `second`
+// waiting behind it
+static Actor *
+_gate_Fill(ActorMailboxPolicy policy, int *first, Future *firstFuture, int *second, Future *secondFuture)
+{
+    _gate_Reset();
+    Actor *actor = actor_CreateLocal(NULL, _gate_Handle, _gate_Release);
+    actor_SetMailbox(actor, 1, policy);
+    actor_Start(actor);
+
+    assert_true(actor_SendMessageAsync(actor, first, future_Retain(firstFuture)));
+    while (__atomic_load_n(&_gateEntered, __ATOMIC_SEQ_CST) == 0) {
+        sched_yield();
+    }
+    assert_true(actor_SendMessageAsync(actor, second, future_Retain(secondFuture)));
+    assert_int_equal(actor_GetQueueDepth(actor), 1);
+    return actor;
+}
+
+static void test_actor_MailboxError(void **state) {
+    int first, second, third;
+    Future *futures[3] = { future_Create(NULL), future_Create(NULL), future_Create(NULL) };
+    Actor *actor = _gate_Fill(ActorMailbox_Error, &first, futures[0], &second, futures[1]);
+
+    // The full mailbox refuses the third message and completes it with NULL
+    assert_false(actor_SendMessageAsync(actor, &third, future_Retain(futures[2])));
+    assert_null(future_Wait(futures[2]));
+    assert_null(actor_SendMessageSync(actor, &third));
+    assert_int_equal(_released, 2);
+
+    _gate_Open();
+    assert_ptr_equal(future_Wait(futures[0]), &first);
+    assert_ptr_equal(future_Wait(futures[1]), &second);
+    for (int i = 0; i < 3; i++) {
+        future_Release(futures[i]);
+    }
+}
+
+static void test_actor_MailboxDropOldest(void **state) {
+    int first, second, third;
+    Future *futures[3] = { future_Create(NULL), future_Create(NULL), future_Create(NULL) };
+    Actor *actor = _gate_Fill(ActorMailbox_DropOldest, &first, futures[0], &second, futures[1]);
+
+    // The third message takes the place of the second, which gets NULL
+    assert_true(actor_SendMessageAsync(actor, &third, future_Retain(futures[2])));
+    assert_null(future_Wait(futures[1]));
+    assert_int_equal(_released, 1);
+    assert_int_equal(actor_GetQueueDepth(actor), 1);
+
+    _gate_Open();
+    assert_ptr_equal(future_Wait(futures[0]), &first);
+    assert_ptr_equal(future_Wait(futures[2]), &third);
+    for (int i = 0; i < 3; i++) {
+        future_Release(futures[i]);
+    }
+}
+
+static void test_actor_PoolLeastLoaded(void **state) {
+    // The first replica is stuck on a message it has already taken off its
+    // queue, so it has an empty mailbox but is not idle
+    int first, second, third, metadata;
+    _gate_Reset();
+    Actor *replicas[2];
+    replicas[0] = actor_CreateLocal(NULL, _gate_Handle, _gate_Release);
+    replicas[1] = actor_CreateLocal(&metadata, _replica_Handle, _replica_Release);
+    Actor *pool = actor_CreatePool(replicas, 2, ActorPool_LeastLoaded);
+    actor_Start(pool);
+
+    Future *busy = future_Create(NULL);
+    assert_true(actor_SendMessageAsync(pool, &first, future_Retain(busy)));
+    while (__atomic_load_n(&_gateEntered, __ATOMIC_SEQ_CST) == 0) {
+        sched_yield();
+    }
+    assert_int_equal(actor_GetQueueDepth(replicas[0]), 0);
+
+    assert_ptr_equal(actor_SendMessageSync(pool, &second), &metadata);
+    assert_ptr_equal(actor_SendMessageSync(pool, &third), &metadata);
+
+    _gate_Open();
+    assert_ptr_equal(future_Wait(busy), &first);
+    future_Release(busy);
+}
+
+static void *
+_blockedSender_Run(void *arg)
+{
+    static int third;
+    return actor_SendMessageSync((Actor *) arg, &third);
+}
+
+static void test_actor_MailboxBlock(void **state) {
+    int first, second;
+    Future *futures[2] = { future_Create(NULL), future_Create(NULL) };
+    Actor *actor = _gate_Fill(ActorMailbox_Block, &first, futures[0], &second, futures[1]);
+
+    // The third sender waits for room rather than losing its message
+    pthread_t sender;
+    pthread_create(&sender, NULL, _blockedSender_Run, actor);
+    usleep(10000);
+    assert_int_equal(actor_GetQueueDepth(actor), 1);
+
+    _gate_Open();
+    void *reply;
+    pthread_join(sender, &reply);
+    assert_non_null(reply);
+    assert_ptr_equal(future_Wait(futures[0]), &first);
+    assert_ptr_equal(future_Wait(futures[1]), &second);
+    assert_int_equal(_released, 0);
+    for (int i = 0; i < 2; i++) {
+        future_Release(futures[i]);
+    }
+}
+
+#define FORWARDED_MESSAGES 50
+
+static int _received;
+
+static void *
+_counter_Handle(void *metadata, void *message)
+{
+    __atomic_add_fetch(&_received, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+// Sends a burst to the actor in its metadata from whichever worker runs it
+static void *
+_forwarder_Handle(void *metadata, void *message)
+{
+    for (int i = 0; i < FORWARDED_MESSAGES; i++) {
+        actor_SendMessageAsync((Actor *) metadata, NULL, NULL);
+    }
+    return NULL;
+}
+
+static void test_actor_BlockOnWorker(void **state) {
+    // More senders than workers, all waiting on a mailbox of one: the
+    // workers must keep running the receiver while the senders wait
+    Actor *counter = actor_CreateLocal(NULL, _counter_Handle, _replica_Release);
+    actor_SetMailbox(counter, 1, ActorMailbox_Block);
+    actor_Start(counter);
+
+    size_t count = scheduler_GetWorkerCount() + 1;
+    Actor *forwarders[count];
+    Future *futures[count];
+    for (size_t i = 0; i < count; i++) {
+        forwarders[i] = actor_CreateLocal(counter, _forwarder_Handle, _replica_Release);
+        actor_Start(forwarders[i]);
+        futures[i] = future_Create(NULL);
+        assert_true(actor_SendMessageAsync(forwarders[i], NULL, future_Retain(futures[i])));
+    }
+    for (size_t i = 0; i < count; i++) {
+        future_Wait(futures[i]);
+        future_Release(futures[i]);
+    }
+
+    while (__atomic_load_n(&_received, __ATOMIC_SEQ_CST) < (int) (count * FORWARDED_MESSAGES)) {
+        sched_yield();
+    }
+    assert_int_equal(actor_GetQueueDepth(counter), 0);
+}
+
 int
 main(int argc, char **argv)
 {
     const struct CMUnitTest tests[] = {
-        cmocka_unit_test(test_actor_CreateLocal)
+        cmocka_unit_test(test_actor_CreateLocal),
+        cmocka_unit_test(test_actor_PoolRoundRobin),
+        cmocka_unit_test(test_actor_PoolWorkSharing),
+        cmocka_unit_test(test_actor_MailboxError),
+        cmocka_unit_test(test_actor_MailboxDropOldest),
+        cmocka_unit_test(test_actor_MailboxBlock),
+        cmocka_unit_test(test_actor_PoolLeastLoaded),
+        cmocka_unit_test(test_actor_BlockOnWorker)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,43 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../buffer.c"
+
+static void test_buffer_AppendGrows(void **state) {
+    CBuffer *buffer = cbuffer_Create();
+    for (int i = 0; i < 1000; i++) {
+        cbuffer_AppendByte(buffer, i & 0xFF);
+    }
+    assert_int_equal(cbuffer_GetLength(buffer), 1000);
+    for (int i = 0; i < 1000; i++) {
+        assert_int_equal(cbuffer_GetBytes(buffer)[i], i & 0xFF);
+    }
+    cbuffer_Delete(&buffer);
+}
+
+static void test_buffer_AppendVarint(void **state) {
+    CBuffer *buffer = cbuffer_Create();
+    cbuffer_AppendVarint(buffer, 0);
+    cbuffer_AppendVarint(buffer, 127);
+    cbuffer_AppendVarint(buffer, 300);
+    cbuffer_AppendVarint(buffer, UINT64_MAX);
+
+    uint8_t expected[] = { 0x00, 0x7F, 0xAC, 0x02,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01 };
+    assert_int_equal(cbuffer_GetLength(buffer), sizeof(expected));
+    assert_memory_equal(cbuffer_GetBytes(buffer), expected, sizeof(expected));
+    cbuffer_Delete(&buffer);
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_buffer_AppendGrows),
+        cmocka_unit_test(test_buffer_AppendVarint)
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
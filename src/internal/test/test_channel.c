@@ -0,0 +1,225 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <pthread.h>
+
+#include "../channel.c"
+
+#define PRODUCER_COUNT 4
+#define MESSAGES_PER_PRODUCER 10000
+
+static void test_channel_TryDequeueEmpty(void **state) {
+    Channel *channel = channel_Create(NULL);
+    assert_null(channel_TryDequeue(channel));
+    assert_int_equal(channel_GetSize(channel), 0);
+    channel_Destroy(&channel);
+}
+
+static void test_channel_DequeueInOrder(void **state) {
+    Channel *channel = channel_Create(NULL);
+    ChannelMessage *first = channelMessage_Create(NULL);
+    ChannelMessage *second = channelMessage_Create(NULL);
+
+    channel_Enqueue(channel, first);
+    channel_Enqueue(channel, second);
+    assert_int_equal(channel_GetSize(channel), 2);
+
+    assert_ptr_equal(channel_Dequeue(channel), first);
+    assert_ptr_equal(channel_TryDequeue(channel), second);
+    assert_null(channel_TryDequeue(channel));
+
+    // The stub must be recycled correctly after the queue drains
+    channel_Enqueue(channel, first);
+    assert_ptr_equal(channel_TryDequeue(channel), first);
+    channelMessage_Destroy(&first);
+    channelMessage_Destroy(&second);
+    channel_Destroy(&channel);
+}
+
+static void *
+_producer_Run(void *arg)
+{
+    Channel *channel = (Channel *) arg;
+    for (int i = 0; i < MESSAGES_PER_PRODUCER; i++) {
+        channel_Enqueue(channel, channelMessage_Create(NULL));
+    }
+    return NULL;
+}
+
+static void test_channel_FanIn(void **state) {
+    Channel *channel = channel_Create(NULL);
+    pthread_t producers[PRODUCER_COUNT];
+    for (int i = 0; i < PRODUCER_COUNT; i++) {
+        pthread_create(&producers[i], NULL, _producer_Run, channel);
+    }
+
+    for (int i = 0; i < PRODUCER_COUNT * MESSAGES_PER_PRODUCER; i++) {
+        ChannelMessage *message = channel_Dequeue(channel);
+        assert_non_null(message);
+        channelMessage_Destroy(&message);
+    }
+
+    for (int i = 0; i < PRODUCER_COUNT; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    assert_null(channel_TryDequeue(channel));
+    assert_int_equal(channel_GetSize(channel), 0);
+    channel_Destroy(&channel);
+}
+
+static void *
+_consumer_Run(void *arg)
+{
+    Channel *channel = (Channel *) arg;
+    ChannelMessage *message = channel_Dequeue(channel);
+    int *payload = (int *) channelMessage_GetPayload(message);
+    *payload += 1;
+    channelMessage_Complete(message, payload);
+    return NULL;
+}
+
+static void test_channel_WaitForReply(void **state) {
+    Channel *channel = channel_Create(NULL);
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, _consumer_Run, channel);
+
+    int payload = 41;
+    ChannelMessage *message = channelMessage_CreateSync(&payload);
+    assert_true(channelMessage_HasWaiter(message));
+    channel_Enqueue(channel, message);
+    int *reply = (int *) channelMessage_Wait(message);
+    assert_ptr_equal(reply, &payload);
+    assert_int_equal(*reply, 42);
+
+    pthread_join(consumer, NULL);
+    channel_Destroy(&channel);
+}
+
+static void test_channel_TryEnqueueFull(void **state) {
+    Channel *channel = channel_Create(NULL);
+    channel_SetCapacity(channel, 1);
+    ChannelMessage *first = channelMessage_Create(NULL);
+    ChannelMessage *second = channelMessage_Create(NULL);
+
+    assert_ptr_equal(channel_TryEnqueue(channel, first), first);
+    assert_null(channel_TryEnqueue(channel, second));
+    assert_int_equal(channel_GetSize(channel), 1);
+
+    assert_ptr_equal(channel_TryDequeue(channel), first);
+    assert_ptr_equal(channel_TryEnqueue(channel, second), second);
+    channelMessage_Destroy(&first);
+
+    // Destroying the channel frees `second`, which is still queued
+    channel_Destroy(&channel);
+}
+
+static void *
+_drainer_Run(void *arg)
+{
+    ChannelMessage *message = channel_Dequeue((Channel *) arg);
+    channelMessage_Destroy(&message);
+    return NULL;
+}
+
+static void test_channel_ParkForSpace(void **state) {
+    Channel *channel = channel_Create(NULL);
+    channel_SetCapacity(channel, 1);
+    ChannelMessage *first = channelMessage_Create(NULL);
+    ChannelMessage *second = channelMessage_Create(NULL);
+    assert_ptr_equal(channel_TryEnqueue(channel, first), first);
+
+    pthread_t drainer;
+    pthread_create(&drainer, NULL, _drainer_Run, channel);
+    while (channel_TryEnqueue(channel, second) == NULL) {
+        channel_ParkForSpace(channel);
+    }
+    pthread_join(drainer, NULL);
+
+    assert_ptr_equal(channel_TryDequeue(channel), second);
+    channelMessage_Destroy(&second);
+    channel_Destroy(&channel);
+}
+
+static void test_channel_EnqueueDropOldest(void **state) {
+    Channel *channel = channel_Create(NULL);
+    channel_SetCapacity(channel, 2);
+    ChannelMessage *first = channelMessage_Create(NULL);
+    ChannelMessage *second = channelMessage_Create(NULL);
+    ChannelMessage *third = channelMessage_Create(NULL);
+
+    assert_null(channel_EnqueueDropOldest(channel, first));
+    assert_null(channel_EnqueueDropOldest(channel, second));
+    assert_ptr_equal(channel_EnqueueDropOldest(channel, third), first);
+    assert_int_equal(channel_GetSize(channel), 2);
+
+    assert_ptr_equal(channel_TryDequeue(channel), second);
+    assert_ptr_equal(channel_TryDequeue(channel), third);
+    channelMessage_Destroy(&first);
+    channelMessage_Destroy(&second);
+    channelMessage_Destroy(&third);
+    channel_Destroy(&channel);
+}
+
+static void test_channel_TryDequeueBatch(void **state) {
+    Channel *channel = channel_Create(NULL);
+    ChannelMessage *messages[3];
+    for (int i = 0; i < 3; i++) {
+        messages[i] = channelMessage_Create(NULL);
+        channel_Enqueue(channel, messages[i]);
+    }
+
+    ChannelMessage *batch[2];
+    assert_int_equal(channel_TryDequeueBatch(channel, batch, 2), 2);
+    assert_ptr_equal(batch[0], messages[0]);
+    assert_ptr_equal(batch[1], messages[1]);
+    assert_int_equal(channel_GetSize(channel), 1);
+
+    assert_int_equal(channel_TryDequeueBatch(channel, batch, 2), 1);
+    assert_ptr_equal(batch[0], messages[2]);
+    assert_int_equal(channel_TryDequeueBatch(channel, batch, 2), 0);
+    assert_int_equal(channel_GetSize(channel), 0);
+    for (int i = 0; i < 3; i++) {
+        channelMessage_Destroy(&messages[i]);
+    }
+    channel_Destroy(&channel);
+}
+
+static void
+_payload_Delete(void **element)
+{
+    free(*element);
+    *element = NULL;
+}
+
+static void test_channel_DestroyWithQueuedMessages(void **state) {
+    Channel *channel = channel_Create(_payload_Delete);
+    for (int i = 0; i < 3; i++) {
+        channel_Enqueue(channel, channelMessage_Create(malloc(sizeof(int))));
+    }
+
+    // Leave the last two queued; Destroy frees them and their payloads
+    ChannelMessage *message = channel_TryDequeue(channel);
+    free(channelMessage_GetPayload(message));
+    channelMessage_Destroy(&message);
+    channel_Destroy(&channel);
+    assert_null(channel);
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_channel_TryDequeueEmpty),
+        cmocka_unit_test(test_channel_DequeueInOrder),
+        cmocka_unit_test(test_channel_FanIn),
+        cmocka_unit_test(test_channel_WaitForReply),
+        cmocka_unit_test(test_channel_TryEnqueueFull),
+        cmocka_unit_test(test_channel_ParkForSpace),
+        cmocka_unit_test(test_channel_EnqueueDropOldest),
+        cmocka_unit_test(test_channel_TryDequeueBatch),
+        cmocka_unit_test(test_channel_DestroyWithQueuedMessages)
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
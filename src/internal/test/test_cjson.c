@@ -0,0 +1,49 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "../encoding/cJSON.c"
+
+// Parse `length` bytes from a heap copy of exactly that size, so that reads
+// or writes past the text show up under a sanitizer
+static cJSON *
+_parse(const char *text, size_t length)
+{
+    char *copy = (char *) malloc(length);
+    memcpy(copy, text, length);
+    cJSON *json = cJSON_Parse(copy);
+    free(copy);
+    return json;
+}
+
+static void test_cjson_ParseString(void **state) {
+    cJSON *json = cJSON_Parse("[\"plain\", \"tab\\there\", \"\\u00e9\\ud83d\\ude00\"]");
+    assert_non_null(json);
+    assert_string_equal(cJSON_GetArrayItem(json, 0)->valuestring, "plain");
+    assert_string_equal(cJSON_GetArrayItem(json, 1)->valuestring, "tab\there");
+    assert_string_equal(cJSON_GetArrayItem(json, 2)->valuestring, "\xc3\xa9\xf0\x9f\x98\x80");
+    cJSON_Delete(json);
+}
+
+static void test_cjson_ParseStringStopsAtTerminator(void **state) {
+    // Escapes cut short by the terminator, with bytes after it that must not be touched
+    static const char backslash[] = "\"ab\\\0xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+    static const char unicode[] = "\"ab\\u12\0xxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+    static const char surrogate[] = "\"ab\\ud83d\\ude\0xxxxxxxxxxxxxxxxxxxxxx";
+    assert_null(_parse(backslash, sizeof(backslash)));
+    assert_null(_parse(unicode, sizeof(unicode)));
+    assert_null(_parse(surrogate, sizeof(surrogate)));
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_cjson_ParseString),
+        cmocka_unit_test(test_cjson_ParseStringStopsAtTerminator)
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
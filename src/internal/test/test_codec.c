@@ -0,0 +1,118 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../../cool.c"
+
+// A list holding one of each kind of value the codecs carry
+static Value *
+_sample()
+{
+    Value *big = value_IntegerFromString("-1267650600228229401496703205376");
+    uint8_t bytes[] = { 0x00, 0x7F, 0x80, 0xFF };
+
+    Value *inner = value_QExpr();
+    inner = value_AddCell(inner, value_String("nested"));
+    inner = value_AddCell(inner, value_SExpr());
+
+    Value *list = value_QExpr();
+    list = value_AddCell(list, value_Integer(0));
+    list = value_AddCell(list, value_Integer(LONG_MIN));
+    list = value_AddCell(list, value_Integer(LONG_MAX));
+    list = value_AddCell(list, big);
+    list = value_AddCell(list, value_Double(0.00001));
+    list = value_AddCell(list, value_Double(-1.2345678901234567e-308));
+    list = value_AddCell(list, value_Double(1e300));
+    list = value_AddCell(list, value_Byte(255));
+    list = value_AddCell(list, value_String("quote \" backslash \\ tab \t newline \n bell \a \xc3\xa9"));
+    list = value_AddCell(list, value_String(""));
+    list = value_AddCell(list, value_Bytes(bytes, sizeof(bytes)));
+    list = value_AddCell(list, inner);
+    return list;
+}
+
+static void test_codec_JSONRoundTrip(void **state) {
+    Value *sample = _sample();
+    CBuffer *encoded = value_EncodeJSON(sample);
+    assert_non_null(encoded);
+
+    Value *decoded = value_DecodeJSON((char *) cbuffer_GetBytes(encoded));
+    assert_non_null(decoded);
+    assert_true(value_Equal(sample, decoded));
+
+    cbuffer_Delete(&encoded);
+    value_Delete(decoded);
+    value_Delete(sample);
+}
+
+static void test_codec_JSONDoubleIsWholeAndExact(void **state) {
+    Value *value = value_Double(0.00001);
+    CBuffer *encoded = value_EncodeJSON(value);
+    assert_string_equal((char *) cbuffer_GetBytes(encoded), "{\"type\":2,\"value\":\"1.0000000000000001e-05\"}");
+    cbuffer_Delete(&encoded);
+    value_Delete(value);
+}
+
+static void test_codec_BinaryRoundTrip(void **state) {
+    Value *sample = _sample();
+    CBuffer *encoded = value_Encode(sample);
+    assert_non_null(encoded);
+
+    Value *decoded = value_Decode(cbuffer_GetBytes(encoded), cbuffer_GetLength(encoded));
+    assert_non_null(decoded);
+    assert_true(value_Equal(sample, decoded));
+
+    // Every proper prefix is malformed
+    for (size_t length = 0; length < cbuffer_GetLength(encoded); length++) {
+        assert_null(value_Decode(cbuffer_GetBytes(encoded), length));
+    }
+
+    cbuffer_Delete(&encoded);
+    value_Delete(decoded);
+    value_Delete(sample);
+}
+
+static void test_codec_BinaryRejectsFunctions(void **state) {
+    Value *lambda = value_Lambda(value_QExpr(), value_QExpr());
+    assert_null(value_Encode(lambda));
+    value_Delete(lambda);
+
+    // A function header with formals and body, as older encoders wrote it
+    const uint8_t function[] = { CoolValue_Function, 2, CoolValue_Qexpr, 0, CoolValue_Qexpr, 0 };
+    assert_null(value_Decode(function, sizeof(function)));
+}
+
+static void test_codec_BinaryLimitsNewSymbols(void **state) {
+    const uint8_t known[] = { CoolValue_Symbol, 1, '&' };
+    const uint8_t unknown[] = { CoolValue_Symbol, 7, 'n', 'o', '-', 's', 'u', 'c', 'h' };
+
+    __atomic_store_n(&_decodedSymbols, VALUE_DECODE_MAX_SYMBOLS, __ATOMIC_RELAXED);
+    Value *symbol = value_Decode(known, sizeof(known));
+    assert_non_null(symbol);
+    assert_int_equal(symbol->symbol, SymbolID_Ampersand);
+    value_Delete(symbol);
+
+    assert_null(value_Decode(unknown, sizeof(unknown)));
+    assert_int_equal(symbol_Lookup("no-such"), -1);
+    __atomic_store_n(&_decodedSymbols, 0, __ATOMIC_RELAXED);
+
+    symbol = value_Decode(unknown, sizeof(unknown));
+    assert_non_null(symbol);
+    assert_string_equal(symbol->symbolString, "no-such");
+    value_Delete(symbol);
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_codec_JSONRoundTrip),
+        cmocka_unit_test(test_codec_JSONDoubleIsWholeAndExact),
+        cmocka_unit_test(test_codec_BinaryRoundTrip),
+        cmocka_unit_test(test_codec_BinaryRejectsFunctions),
+        cmocka_unit_test(test_codec_BinaryLimitsNewSymbols)
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,98 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "../future.c"
+
+static void test_future_WaitAfterComplete(void **state) {
+    int value = 7;
+    Future *future = future_Create(NULL);
+    assert_false(future_IsDone(future));
+
+    future_Complete(future, &value);
+    assert_true(future_IsDone(future));
+    assert_ptr_equal(future_Wait(future), &value);
+    future_Release(future);
+}
+
+static void *
+_completer_Run(void *arg)
+{
+    static int value = 42;
+    usleep(10000);
+    future_Complete((Future *) arg, &value);
+    future_Release((Future *) arg);
+    return NULL;
+}
+
+static void test_future_WaitBeforeComplete(void **state) {
+    Future *future = future_Create(NULL);
+    pthread_t completer;
+    pthread_create(&completer, NULL, _completer_Run, future_Retain(future));
+
+    int *result = (int *) future_Wait(future);
+    assert_int_equal(*result, 42);
+
+    pthread_join(completer, NULL);
+    future_Release(future);
+}
+
+static void
+_record_Callback(void *context, void *result)
+{
+    int *order = (int *) context;
+    order[order[0]++ + 1] = *(int *) result;
+}
+
+static void test_future_Then(void **state) {
+    int order[4] = { 0 };
+    int first = 1;
+
+    Future *future = future_Create(NULL);
+    future_Then(future, _record_Callback, order);
+    future_Complete(future, &first);
+    assert_int_equal(order[0], 1);
+
+    // Attached after completion: runs right away with the same result
+    future_Then(future, _record_Callback, order);
+    assert_int_equal(order[0], 2);
+    assert_int_equal(order[1], first);
+    assert_int_equal(order[2], first);
+    future_Release(future);
+}
+
+static int _released;
+
+static void
+_count_Release(void *result)
+{
+    _released++;
+}
+
+static void test_future_ReleaseFreesResult(void **state) {
+    int value = 1;
+    Future *future = future_Create(_count_Release);
+    future_Retain(future);
+    future_Complete(future, &value);
+
+    future_Release(future);
+    assert_int_equal(_released, 0);
+    future_Release(future);
+    assert_int_equal(_released, 1);
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_future_WaitAfterComplete),
+        cmocka_unit_test(test_future_WaitBeforeComplete),
+        cmocka_unit_test(test_future_Then),
+        cmocka_unit_test(test_future_ReleaseFreesResult)
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,106 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../encoding/json_scan.c"
+
+#define SCAN_LENGTH 100
+
+// Every implementation this CPU can run, scalar first
+static size_t
+_scanners(JSONScanner *skipSpace, JSONScanner *findSpecial)
+{
+    size_t count = 0;
+    skipSpace[count] = _jsonScan_SkipSpaceScalar;
+    findSpecial[count++] = _jsonScan_FindSpecialScalar;
+#ifdef JSON_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        skipSpace[count] = _jsonScan_SkipSpaceSSE2;
+        findSpecial[count++] = _jsonScan_FindSpecialSSE2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        skipSpace[count] = _jsonScan_SkipSpaceAVX2;
+        findSpecial[count++] = _jsonScan_FindSpecialAVX2;
+    }
+#endif
+    return count;
+}
+
+static void test_jsonScan_MatchesScalar(void **state) {
+    static const char alphabet[] = { ' ', '\t', '\n', '\r', '"', '\\', 'a', 'z', 0x01, 0x1F, 0x7F, (char) 0x80, (char) 0xFF };
+    JSONScanner skipSpace[3], findSpecial[3];
+    size_t count = _scanners(skipSpace, findSpecial);
+
+    // Mostly plain or mostly space, so that stops land at every position
+    char text[SCAN_LENGTH + 64];
+    srand(1);
+    for (int round = 0; round < 20000; round++) {
+        size_t length = rand() % SCAN_LENGTH;
+        size_t start = rand() % 32;
+        int plain = round % 2;
+        for (size_t i = 0; i < length; i++) {
+            if (rand() % 16 == 0) {
+                text[start + i] = alphabet[rand() % sizeof(alphabet)];
+            } else {
+                text[start + i] = plain ? 'x' : ' ';
+            }
+        }
+        text[start + length] = '\0';
+
+        const char *space = _jsonScan_SkipSpaceScalar(text + start);
+        const char *special = _jsonScan_FindSpecialScalar(text + start);
+        for (size_t i = 1; i < count; i++) {
+            assert_true(skipSpace[i](text + start) == space);
+            assert_true(findSpecial[i](text + start) == special);
+        }
+    }
+}
+
+static void test_jsonScan_StopsAtEndOfPage(void **state) {
+    // A string ending on the last byte of a mapped page must not fault
+    JSONScanner skipSpace[3], findSpecial[3];
+    size_t count = _scanners(skipSpace, findSpecial);
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    char *pages = (char *) mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert_true(pages != MAP_FAILED);
+    assert_int_equal(mprotect(pages + page, page, PROT_NONE), 0);
+
+    for (size_t length = 0; length < 64; length++) {
+        char *text = pages + page - length - 1;
+        memset(text, ' ', length);
+        text[length] = '\0';
+        for (size_t i = 0; i < count; i++) {
+            assert_true(skipSpace[i](text) == text + length);
+        }
+        memset(text, 'x', length);
+        for (size_t i = 0; i < count; i++) {
+            assert_true(findSpecial[i](text) == text + length);
+        }
+    }
+    munmap(pages, 2 * page);
+}
+
+static void test_jsonScan_Dispatch(void **state) {
+    assert_string_equal(jsonScan_SkipSpace(" \t\n\rvalue"), "value");
+    assert_string_equal(jsonScan_SkipSpace("value"), "value");
+    assert_string_equal(jsonScan_FindSpecial("plain text \\n escape"), "\\n escape");
+    assert_string_equal(jsonScan_FindSpecial("ends here\" after"), "\" after");
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_jsonScan_MatchesScalar),
+        cmocka_unit_test(test_jsonScan_StopsAtEndOfPage),
+        cmocka_unit_test(test_jsonScan_Dispatch)
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
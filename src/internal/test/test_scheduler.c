@@ -0,0 +1,111 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "../scheduler.c"
+
+#define TASK_COUNT 1000
+
+typedef struct {
+    SchedulerTask task;
+    int *counter;
+} CountingTask;
+
+static void
+countingTask_Run(SchedulerTask *task)
+{
+    CountingTask *counting = (CountingTask *) task;
+    __sync_add_and_fetch(counting->counter, 1);
+}
+
+static void test_scheduler_GetWorkerCount(void **state) {
+    assert_true(scheduler_GetWorkerCount() > 0);
+    assert_false(scheduler_IsWorker());
+}
+
+static void test_scheduler_SubmitRunsEveryTask(void **state) {
+    int counter = 0;
+    CountingTask tasks[TASK_COUNT];
+    for (int i = 0; i < TASK_COUNT; i++) {
+        tasks[i].task.run = countingTask_Run;
+        tasks[i].counter = &counter;
+        scheduler_Submit(&tasks[i].task);
+    }
+
+    while (__sync_fetch_and_add(&counter, 0) < TASK_COUNT) {
+        usleep(1000);
+    }
+    assert_int_equal(counter, TASK_COUNT);
+}
+
+static void test_scheduler_RunOneOutsideWorker(void **state) {
+    assert_int_equal(scheduler_RunOne(), 0);
+}
+
+typedef struct waiting_task {
+    SchedulerTask task;
+    Parker *parker;
+    int signalled;
+    int done;
+    struct waiting_task *target; // the task to signal
+} WaitingTask;
+
+static void
+waitingTask_Wait(SchedulerTask *task)
+{
+    WaitingTask *waiting = (WaitingTask *) task;
+    Parker *parker = parker_GetThreadParker();
+    __atomic_store_n(&waiting->parker, parker, __ATOMIC_RELEASE);
+    while (!__atomic_load_n(&waiting->signalled, __ATOMIC_ACQUIRE)) {
+        parker_Park(parker);
+    }
+    __atomic_store_n(&waiting->done, 1, __ATOMIC_RELEASE);
+}
+
+static void
+waitingTask_Signal(SchedulerTask *task)
+{
+    WaitingTask *waiting = ((WaitingTask *) task)->target;
+    __atomic_store_n(&waiting->signalled, 1, __ATOMIC_RELEASE);
+    parker_Unpark(waiting->parker);
+}
+
+static void test_scheduler_ParkSuspendsOnlyTheTask(void **state) {
+    // Park more tasks than there are workers; if parking blocked the worker
+    // thread, the tasks that unpark them would never run
+    size_t count = scheduler_GetWorkerCount() + 1;
+    WaitingTask *waiting = (WaitingTask *) calloc(2 * count, sizeof(WaitingTask));
+    for (size_t i = 0; i < count; i++) {
+        waiting[i].task.run = waitingTask_Wait;
+        scheduler_Submit(&waiting[i].task);
+    }
+    for (size_t i = 0; i < count; i++) {
+        while (__atomic_load_n(&waiting[i].parker, __ATOMIC_ACQUIRE) == NULL) {
+            usleep(1000);
+        }
+        waiting[count + i].task.run = waitingTask_Signal;
+        waiting[count + i].target = &waiting[i];
+        scheduler_Submit(&waiting[count + i].task);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        while (!__atomic_load_n(&waiting[i].done, __ATOMIC_ACQUIRE)) {
+            usleep(1000);
+        }
+    }
+    free(waiting);
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_scheduler_GetWorkerCount),
+        cmocka_unit_test(test_scheduler_SubmitRunsEveryTask),
+        cmocka_unit_test(test_scheduler_RunOneOutsideWorker),
+        cmocka_unit_test(test_scheduler_ParkSuspendsOnlyTheTask)
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,91 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <pthread.h>
+
+#include "../slab.c"
+
+static void test_slab_AllocateReusesFreedObject(void **state) {
+    void *first = slab_Allocate(40);
+    slab_Free(first, 40);
+    void *second = slab_Allocate(48); // same size class
+    assert_ptr_equal(first, second);
+    slab_Free(second, 48);
+}
+
+static void test_slab_ReallocateKeepsContents(void **state) {
+    uint8_t *bytes = (uint8_t *) slab_Allocate(16);
+    for (int i = 0; i < 16; i++) {
+        bytes[i] = (uint8_t) i;
+    }
+    bytes = (uint8_t *) slab_Reallocate(bytes, 16, 1024);
+    for (int i = 0; i < 16; i++) {
+        assert_int_equal(bytes[i], i);
+    }
+    slab_Free(bytes, 1024);
+}
+
+static void test_slab_GetStats(void **state) {
+    SlabStats before = slab_GetStats();
+
+    void *objects[100];
+    for (int i = 0; i < 100; i++) {
+        objects[i] = slab_Allocate(96);
+    }
+    SlabStats during = slab_GetStats();
+    assert_int_equal(during.live, before.live + 100);
+    assert_true(during.peak >= during.live);
+
+    for (int i = 0; i < 100; i++) {
+        slab_Free(objects[i], 96);
+    }
+    SlabStats after = slab_GetStats();
+    assert_int_equal(after.live, before.live);
+    assert_int_equal(after.peak, during.peak);
+}
+
+#define FREED_ELSEWHERE (SLAB_STATS_BATCH - 1)
+
+static void *
+_freer_Run(void *arg)
+{
+    void **objects = (void **) arg;
+    for (int i = 0; i < FREED_ELSEWHERE; i++) {
+        slab_Free(objects[i], 96);
+    }
+    return NULL;
+}
+
+static void test_slab_GetStatsAcrossThreads(void **state) {
+    // Another thread frees what this one allocated and, on exit, flushes
+    // its share of the count before this thread flushes its own, which
+    // leaves the global count briefly below zero
+    SlabStats before = slab_GetStats();
+    assert_true(before.live < FREED_ELSEWHERE);
+
+    void *objects[FREED_ELSEWHERE];
+    for (int i = 0; i < FREED_ELSEWHERE; i++) {
+        objects[i] = slab_Allocate(96);
+    }
+    pthread_t freer;
+    pthread_create(&freer, NULL, _freer_Run, objects);
+    pthread_join(freer, NULL);
+
+    SlabStats after = slab_GetStats();
+    assert_int_equal(after.live, before.live);
+    assert_true(after.peak <= before.peak + FREED_ELSEWHERE);
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_slab_AllocateReusesFreedObject),
+        cmocka_unit_test(test_slab_ReallocateKeepsContents),
+        cmocka_unit_test(test_slab_GetStats),
+        cmocka_unit_test(test_slab_GetStatsAcrossThreads)
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
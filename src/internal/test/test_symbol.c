@@ -0,0 +1,87 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <pthread.h>
+
+#include "../symbol.c"
+
+static void test_symbol_InternIsStable(void **state) {
+    SymbolID first = symbol_Intern("fact");
+    SymbolID second = symbol_Intern("fact");
+    assert_int_equal(first, second);
+    assert_true(symbol_Intern("fib") != first);
+    assert_string_equal(symbol_Name(first), "fact");
+}
+
+static void test_symbol_Ampersand(void **state) {
+    assert_int_equal(symbol_Intern("&"), SymbolID_Ampersand);
+}
+
+static void test_symbol_LookupDoesNotIntern(void **state) {
+    assert_int_equal(symbol_Lookup("never-interned"), -1);
+    assert_int_equal(symbol_Lookup("never-interned"), -1);
+    SymbolID id = symbol_Intern("never-interned");
+    assert_int_equal(symbol_Lookup("never-interned"), id);
+}
+
+static void test_symbol_InternManySymbols(void **state) {
+    char name[32];
+    SymbolID ids[5000];
+    for (int i = 0; i < 5000; i++) {
+        sprintf(name, "symbol-%d", i);
+        ids[i] = symbol_Intern(name);
+    }
+    for (int i = 0; i < 5000; i++) {
+        sprintf(name, "symbol-%d", i);
+        assert_int_equal(symbol_Intern(name), ids[i]);
+        assert_string_equal(symbol_Name(ids[i]), name);
+    }
+}
+
+#define INTERN_THREADS 4
+#define INTERN_NAMES 3000
+
+// Every thread interns the same names, forcing the table to grow while
+// others are looking names up
+static void *
+_interner_Run(void *arg)
+{
+    SymbolID *ids = (SymbolID *) arg;
+    char name[32];
+    for (int i = 0; i < INTERN_NAMES; i++) {
+        sprintf(name, "shared-%d", i);
+        ids[i] = symbol_Intern(name);
+        sprintf(name, "shared-%d", i / 2);
+        assert_int_equal(symbol_Lookup(name), ids[i / 2]);
+    }
+    return NULL;
+}
+
+static void test_symbol_InternConcurrently(void **state) {
+    static SymbolID ids[INTERN_THREADS][INTERN_NAMES];
+    pthread_t threads[INTERN_THREADS];
+    for (int i = 0; i < INTERN_THREADS; i++) {
+        pthread_create(&threads[i], NULL, _interner_Run, ids[i]);
+    }
+    for (int i = 0; i < INTERN_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 1; i < INTERN_THREADS; i++) {
+        assert_memory_equal(ids[i], ids[0], sizeof(ids[0]));
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_symbol_InternIsStable),
+        cmocka_unit_test(test_symbol_Ampersand),
+        cmocka_unit_test(test_symbol_LookupDoesNotIntern),
+        cmocka_unit_test(test_symbol_InternManySymbols),
+        cmocka_unit_test(test_symbol_InternConcurrently)
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}